@@ -58,9 +58,73 @@ static int str_isalnum_(const char *s)
 	return 1;
 }
 
+#if ENABLE_FEATURE_APPLET_HASH
+/* Perfect hash: name goes to bucket bb_applet_hash(name, 0, nbuckets),
+ * each bucket has a "displacement" d (1..255, 0 for empty buckets),
+ * and bb_applet_hash(name, d, NUM_APPLETS) is a slot no other name has.
+ * Buckets are placed biggest first, trying every d until all names
+ * of the bucket land in free slots.
+ */
+static unsigned char hash_disp[NUM_APPLETS];
+static int hash_slot[NUM_APPLETS]; /* slot -> applet# */
+
+static int build_hash(unsigned nbuckets)
+{
+	int bucket[NUM_APPLETS];
+	unsigned size[NUM_APPLETS];
+	unsigned i, b, sz, d, k;
+
+	memset(size, 0, sizeof(size));
+	for (i = 0; i < NUM_APPLETS; i++) {
+		bucket[i] = bb_applet_hash(applets[i].name, 0, nbuckets);
+		size[bucket[i]]++;
+	}
+	memset(hash_disp, 0, sizeof(hash_disp));
+	for (i = 0; i < NUM_APPLETS; i++)
+		hash_slot[i] = -1;
+
+	for (sz = NUM_APPLETS; sz > 0; sz--) {
+		for (b = 0; b < nbuckets; b++) {
+			int slot[NUM_APPLETS];
+
+			if (size[b] != sz)
+				continue;
+			for (d = 1; d < 256; d++) {
+				k = 0;
+				for (i = 0; i < NUM_APPLETS; i++) {
+					unsigned m, s;
+					if (bucket[i] != (int)b)
+						continue;
+					s = bb_applet_hash(applets[i].name, d, NUM_APPLETS);
+					if (hash_slot[s] >= 0)
+						break;
+					for (m = 0; m < k; m++)
+						if (slot[m] == (int)s)
+							break;
+					if (m < k)
+						break;
+					slot[k++] = s;
+				}
+				if (i == NUM_APPLETS)
+					break; /* all of them have free slots */
+			}
+			if (d == 256)
+				return 0;
+			hash_disp[b] = d;
+			k = 0;
+			for (i = 0; i < NUM_APPLETS; i++)
+				if (bucket[i] == (int)b)
+					hash_slot[slot[k++]] = i;
+		}
+	}
+	return 1;
+}
+#endif
+
 int main(int argc, char **argv)
 {
 	int i, j;
+	unsigned hash_buckets = 0;
 
 	// In find_applet_by_name(), before linear search, narrow it down
 	// by looking at N "equidistant" names. With ~350 applets:
@@ -82,6 +146,23 @@ int main(int argc, char **argv)
 
 	qsort(applets, NUM_APPLETS, sizeof(applets[0]), cmp_name);
 
+#if ENABLE_FEATURE_APPLET_HASH
+	// Fewer buckets: smaller table, but harder to find displacements.
+	// 366 applets need 141 buckets.
+	if (NUM_APPLETS > 1) {
+		for (hash_buckets = (NUM_APPLETS + 3) / 4; ; hash_buckets++) {
+			if (hash_buckets > NUM_APPLETS) {
+				hash_buckets = 0; /* failed, use search */
+				break;
+			}
+			if (build_hash(hash_buckets)) {
+				KNOWN_APPNAME_OFFSETS = 0; /* not needed */
+				break;
+			}
+		}
+	}
+#endif
+
 	if (!argv[1])
 		return 1;
 	i = open(argv[1], O_WRONLY | O_TRUNC | O_CREAT, 0666);
@@ -129,6 +210,28 @@ int main(int argc, char **argv)
 	}
 	printf(";\n\n");
 
+	if (hash_buckets) {
+		int ofs = 0;
+
+		printf("#define APPLET_HASH_BUCKETS %u\n", hash_buckets);
+		printf("const uint8_t applet_hash_disp[] ALIGN1 = {\n");
+		for (i = 0; i < (int)hash_buckets; i++)
+			printf("%u,\n", hash_disp[i]);
+		printf("};\n");
+		printf("const uint16_t applet_hash_no[] ALIGN2 = {\n");
+		for (i = 0; i < NUM_APPLETS; i++)
+			printf("%d,\n", hash_slot[i]);
+		printf("};\n");
+		printf("const uint16_t applet_name_ofs[] ALIGN2 = {\n");
+		for (i = 0; i < NUM_APPLETS; i++) {
+			printf("%d,\n", ofs);
+			ofs += strlen(applets[i].name) + 1;
+		}
+		printf("};\n\n");
+		if (ofs > 0xffff)
+			return 1;
+	}
+
 	for (i = 0; i < NUM_APPLETS; i++) {
 		if (str_isalnum_(applets[i].name))
 			printf("#define APPLET_NO_%s %d\n", applets[i].name, i);
@@ -19,6 +19,15 @@
 //config:
 //config:	  Unless you have a specific application which requires bzip2, you
 //config:	  should probably say N here.
+//config:
+//config:config FEATURE_BZIP2_PARALLEL
+//config:	bool "Enable parallel compression (-p N)"
+//config:	default y
+//config:	depends on BZIP2 && !NOMMU
+//config:	help
+//config:	  Enable -p N option which compresses up to N blocks at once
+//config:	  in worker processes. Blocks are independent, the resulting
+//config:	  bit streams are concatenated in order into one .bz2 stream.
 
 //applet:IF_BZIP2(APPLET(bzip2, BB_DIR_USR_BIN, BB_SUID_DROP))
 //kbuild:lib-$(CONFIG_BZIP2) += bzip2.o
@@ -31,6 +40,9 @@
 //usage:     "\n	-d	Decompress"
 //usage:     "\n	-c	Write to stdout"
 //usage:     "\n	-f	Force"
+//usage:	IF_FEATURE_BZIP2_PARALLEL(
+//usage:     "\n	-p N	Compress using N processes (0: one per CPU)"
+//usage:	)
 
 #include "libbb.h"
 #include "bb_archive.h"
@@ -78,6 +90,11 @@ enum {
 };
 
 static uint8_t level;
+#if ENABLE_FEATURE_BZIP2_PARALLEL
+static unsigned nproc;
+/* Same cap as gzip -p: N chunks are buffered, N workers are forked */
+# define PAR_MAX_PROCS 256
+#endif
 
 /* NB: compressStream() has to return -1 on errors, not die.
  * bbunpack() will correctly clean up in this case
@@ -126,6 +143,167 @@ IF_DESKTOP(long long) int bz_write(bz_stream *strm, void* rbuf, ssize_t rlen, vo
 	return 0 IF_DESKTOP( + strm->total_out );
 }
 
+#if ENABLE_FEATURE_BZIP2_PARALLEL
+/* Parallel mode: input is cut into chunks of blockSize100k * 100000 bytes.
+ * Every chunk is compressed by a forked worker into one block (two if
+ * initial RLE expands it past nblockMAX). Block bit streams are not byte
+ * aligned: worker reports its trailing partial byte separately,
+ * and parent shifts worker output into place.
+ */
+#define PAR_MAX_BLOCKS 4
+struct par_slot {
+	uint32_t len;     /* whole bytes of output */
+	uint8_t  tbits;   /* number of trailing bits (0..7) */
+	uint8_t  tval;    /* trailing bits, right-aligned */
+	uint8_t  nblocks;
+	uint32_t crc[PAR_MAX_BLOCKS];
+	uint8_t  data[1];
+};
+
+static void par_compress_chunk(EState *s, void *buf, unsigned len,
+		struct par_slot *slot, unsigned room)
+{
+	bz_stream *strm = s->strm;
+
+	strm->next_in = buf;
+	strm->avail_in = len;
+	init_RL(s);
+	BZ2_bsInitWrite(s);
+	/* prepare_new_block() bumps it to 2 and up, so that
+	 * BZ2_compressBlock() never writes a stream header */
+	s->blockNo = 1;
+	slot->len = 0;
+	slot->nblocks = 0;
+	do {
+		prepare_new_block(s);
+		copy_input_until_stop(s);
+		if (strm->avail_in == 0)
+			flush_RL(s);
+		BZ2_compressBlock(s, 0);
+		if (slot->nblocks == PAR_MAX_BLOCKS
+		 || slot->len + s->numZ + 4 > room
+		) {
+			bb_error_msg_and_die("block overflow");
+		}
+		slot->crc[slot->nblocks++] = s->blockCRC;
+		memcpy(slot->data + slot->len, s->zbits, s->numZ);
+		slot->len += s->numZ;
+	} while (strm->avail_in != 0);
+
+	/* Emit whole bytes, leave less than 8 bits pending */
+	while (s->bsLive >= 8) {
+		slot->data[slot->len++] = (uint8_t)(s->bsBuff >> 24);
+		s->bsBuff <<= 8;
+		s->bsLive -= 8;
+	}
+	slot->tbits = s->bsLive;
+	slot->tval = s->bsLive ? s->bsBuff >> (32 - s->bsLive) : 0;
+}
+
+static int par_flush(EState *s)
+{
+	int n = full_write(STDOUT_FILENO, s->zbits, s->numZ);
+	if (n != s->numZ) {
+		if (n >= 0)
+			errno = 0; /* prevent bogus error message */
+		bb_perror_msg(n >= 0 ? "short write" : bb_msg_write_error);
+		return -1;
+	}
+	s->numZ = 0;
+	return n;
+}
+
+static
+IF_DESKTOP(long long) int compressStream_parallel(bz_stream *strm)
+{
+	EState *s = strm->state;
+	unsigned chunk = 100000 * s->blockSize100k;
+	unsigned slotsize = (sizeof(struct par_slot) + chunk + chunk / 4 + 1024) & ~3;
+	IF_DESKTOP(long long) int total = 0;
+	pid_t *pids = xmalloc(nproc * sizeof(pids[0]));
+	uint8_t *inbuf = xmalloc(nproc * chunk);
+	uint8_t *slots = mmap(NULL, nproc * slotsize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (slots == MAP_FAILED)
+		bb_perror_msg_and_die("mmap");
+
+	/* Parent uses arr2 purely as output buffer for the bit stream */
+	s->zbits = (uint8_t*)s->arr2;
+	BZ2_bsInitWrite(s);
+	bsPutU32(s, BZ_HDR_BZh0 + s->blockSize100k);
+
+	for (;;) {
+		ssize_t count;
+		unsigned i, n;
+
+		count = full_read(STDIN_FILENO, inbuf, nproc * chunk);
+		if (count < 0) {
+			bb_perror_msg(bb_msg_read_error);
+			total = -1;
+			goto ret;
+		}
+		if (count == 0)
+			break;
+
+		n = (count + chunk - 1) / chunk;
+		for (i = 0; i < n; i++) {
+			pids[i] = xfork();
+			if (pids[i] == 0) {
+				par_compress_chunk(s, inbuf + i * chunk,
+					MIN(chunk, count - i * chunk),
+					(void*)(slots + i * slotsize),
+					slotsize - sizeof(struct par_slot));
+				_exit(EXIT_SUCCESS);
+			}
+		}
+		for (i = 0; i < n; i++) {
+			if (wait4pid(pids[i]) != 0)
+				bb_error_msg_and_die("worker process failed");
+		}
+
+		for (i = 0; i < n; i++) {
+			struct par_slot *slot = (void*)(slots + i * slotsize);
+			uint32_t j;
+
+			for (j = 0; j < slot->nblocks; j++) {
+				s->combinedCRC = (s->combinedCRC << 1) | (s->combinedCRC >> 31);
+				s->combinedCRC ^= slot->crc[j];
+			}
+			for (j = 0; j < slot->len; j++) {
+				bsW(s, 8, slot->data[j]);
+				if (s->numZ >= IOBUF_SIZE) {
+					if (par_flush(s) < 0) {
+						total = -1;
+						goto ret;
+					}
+					total += IOBUF_SIZE;
+				}
+			}
+			if (slot->tbits)
+				bsW(s, slot->tbits, slot->tval);
+		}
+
+		if (count != nproc * chunk)
+			break; /* EOF */
+	}
+
+	/* Stream trailer, same as BZ2_compressBlock() writes */
+	bsPutU32(s, 0x17724538);
+	bsPutU16(s, 0x5090);
+	bsPutU32(s, s->combinedCRC);
+	bsFinishWrite(s);
+	total += s->numZ;
+	if (par_flush(s) < 0)
+		total = -1;
+ ret:
+	munmap(slots, nproc * slotsize);
+	free(inbuf);
+	free(pids);
+	return total;
+}
+#endif
+
 static
 IF_DESKTOP(long long) int FAST_FUNC compressStream(transformer_state_t *xstate UNUSED_PARAM)
 {
@@ -140,6 +318,13 @@ IF_DESKTOP(long long) int FAST_FUNC compressStream(transformer_state_t *xstate U
 	iobuf = xmalloc(2 * IOBUF_SIZE);
 	BZ2_bzCompressInit(strm, level);
 
+#if ENABLE_FEATURE_BZIP2_PARALLEL
+	if (nproc) {
+		total = compressStream_parallel(strm);
+		goto done;
+	}
+#endif
+
 	while (1) {
 		count = full_read(STDIN_FILENO, rbuf, IOBUF_SIZE);
 		if (count < 0) {
@@ -153,6 +338,9 @@ IF_DESKTOP(long long) int FAST_FUNC compressStream(transformer_state_t *xstate U
 			break;
 	}
 
+#if ENABLE_FEATURE_BZIP2_PARALLEL
+ done:
+#endif
 	/* Can't be conditional on ENABLE_FEATURE_CLEAN_UP -
 	 * we are called repeatedly
 	 */
@@ -166,6 +354,7 @@ int bzip2_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int bzip2_main(int argc UNUSED_PARAM, char **argv)
 {
 	unsigned opt;
+	IF_FEATURE_BZIP2_PARALLEL(const char *p_str;)
 
 	/* standard bzip2 flags
 	 * -d --decompress force decompression
@@ -184,7 +373,18 @@ int bzip2_main(int argc UNUSED_PARAM, char **argv)
 
 	opt_complementary = "s2"; /* -s means -2 (compatibility) */
 	/* Must match bbunzip's constants OPT_STDOUT, OPT_FORCE! */
-	opt = getopt32(argv, "cfv" IF_BUNZIP2("dt") "123456789qzs");
+	opt = getopt32(argv, "cfv" IF_BUNZIP2("dt") "123456789qzs" IF_FEATURE_BZIP2_PARALLEL("p:")
+			IF_FEATURE_BZIP2_PARALLEL(, &p_str)
+	);
+#if ENABLE_FEATURE_BZIP2_PARALLEL
+	if (opt & (1 << (ENABLE_BUNZIP2 ? 17 : 15))) {
+		nproc = xatou_range(p_str, 0, PAR_MAX_PROCS);
+		if (nproc == 0)
+			nproc = MIN(get_cpu_count(), PAR_MAX_PROCS);
+		if (nproc == 1) /* not worth it */
+			nproc = 0;
+	}
+#endif
 #if ENABLE_BUNZIP2 /* bunzip2_main may not be visible... */
 	if (opt & 0x18) // -d and/or -t
 		return bunzip2_main(argc, argv);
@@ -72,12 +72,24 @@ aa:      85.1% -- replaced with aa.gz
 //config:	  is 6. If levels 1-3 are specified, 4 is used.
 //config:	  If this option is not selected, -N options are ignored and -9
 //config:	  is used.
+//config:
+//config:config FEATURE_GZIP_PARALLEL
+//config:	bool "Enable parallel compression (-p N)"
+//config:	default y
+//config:	depends on GZIP && !NOMMU
+//config:	help
+//config:	  Enable -p N option which splits input into 128k blocks
+//config:	  and deflates up to N of them at once in worker processes.
+//config:	  Each block is primed with the preceding 32k of input as its
+//config:	  dictionary, so the result is a single standard gzip member.
+//config:	  Output does not depend on N, but differs from non-parallel
+//config:	  output (blocks end with an empty stored block).
 
 //applet:IF_GZIP(APPLET(gzip, BB_DIR_BIN, BB_SUID_DROP))
 //kbuild:lib-$(CONFIG_GZIP) += gzip.o
 
 //usage:#define gzip_trivial_usage
-//usage:       "[-cf" IF_GUNZIP("d") IF_FEATURE_GZIP_LEVELS("123456789") "] [FILE]..."
+//usage:       "[-cf" IF_GUNZIP("d") IF_FEATURE_GZIP_LEVELS("123456789") "]" IF_FEATURE_GZIP_PARALLEL(" [-p N]") " [FILE]..."
 //usage:#define gzip_full_usage "\n\n"
 //usage:       "Compress FILEs (or stdin)\n"
 //usage:	IF_FEATURE_GZIP_LEVELS(
@@ -88,6 +100,9 @@ aa:      85.1% -- replaced with aa.gz
 //usage:	)
 //usage:     "\n	-c	Write to stdout"
 //usage:     "\n	-f	Force"
+//usage:	IF_FEATURE_GZIP_PARALLEL(
+//usage:     "\n	-p N	Compress using N processes (0: one per CPU)"
+//usage:	)
 //usage:
 //usage:#define gzip_example_usage
 //usage:       "$ ls -la /tmp/busybox*\n"
@@ -421,6 +436,17 @@ struct globals {
 
 	/*uint32_t *crc_32_tab;*/
 	uint32_t crc;	/* shift register contents */
+
+#if ENABLE_FEATURE_GZIP_PARALLEL
+	unsigned nproc;	/* -p N: number of worker processes, 0 if not parallel */
+/* In a worker process, input comes from memory and output goes
+ * to a shared memory slot instead of ifd/ofd.
+ */
+	const uch *par_in;
+	unsigned par_inleft;
+	uch *par_out;
+	unsigned par_outleft;
+#endif
 };
 
 #define G1 (*(ptr_to_globals - 1))
@@ -435,6 +461,17 @@ static void flush_outbuf(void)
 	if (G1.outcnt == 0)
 		return;
 
+#if ENABLE_FEATURE_GZIP_PARALLEL
+	if (G1.par_out) {
+		if (G1.outcnt > G1.par_outleft)
+			bb_error_msg_and_die("block overflow");
+		memcpy(G1.par_out, G1.outbuf, G1.outcnt);
+		G1.par_out += G1.outcnt;
+		G1.par_outleft -= G1.outcnt;
+		G1.outcnt = 0;
+		return;
+	}
+#endif
 	xwrite(ofd, (char *) G1.outbuf, G1.outcnt);
 	G1.outcnt = 0;
 }
@@ -516,6 +553,16 @@ static unsigned file_read(void *buf, unsigned size)
 
 	Assert(G1.insize == 0, "l_buf not empty");
 
+#if ENABLE_FEATURE_GZIP_PARALLEL
+	if (G1.par_in) {
+		/* Worker: parent takes care of crc and isize */
+		len = MIN(size, G1.par_inleft);
+		memcpy(buf, G1.par_in, len);
+		G1.par_in += len;
+		G1.par_inleft -= len;
+		return len;
+	}
+#endif
 	len = safe_read(ifd, buf, size);
 	if (len == (unsigned)(-1) || len == 0)
 		return len;
@@ -1802,7 +1849,7 @@ do { \
 	head[G1.ins_h] = (s); \
 } while (0)
 
-static ulg deflate(void)
+static ulg deflate(int eof)
 {
 	IPos hash_head;		/* head of hash chain */
 	IPos prev_match;	/* previous match */
@@ -1904,7 +1951,7 @@ static ulg deflate(void)
 	if (match_available)
 		ct_tally(0, G1.window[G1.strstart - 1]);
 
-	return FLUSH_BLOCK(1);	/* eof */
+	return FLUSH_BLOCK(eof);
 }
 
 
@@ -1967,7 +2014,7 @@ static void lm_init(ush * flagsp)
  * Allocate the match buffer, initialize the various tables and save the
  * location of the internal file attribute (ascii/binary) and method
  * (DEFLATE/STORE).
- * One callsite in zip()
+ * Callsites in zip() and zip_parallel()
  */
 static void ct_init(void)
 {
@@ -2083,7 +2130,7 @@ static void zip(void)
 	put_8bit(deflate_flags);	/* extra flags */
 	put_8bit(3);	/* OS identifier = 3 (Unix) */
 
-	deflate();
+	deflate(1);
 
 	/* Write the crc and uncompressed size */
 	put_32bit(~G1.crc);
@@ -2092,6 +2139,145 @@ static void zip(void)
 	flush_outbuf();
 }
 
+#if ENABLE_FEATURE_GZIP_PARALLEL
+/* ===========================================================================
+ * Parallel mode: input is cut into PAR_BLOCK sized pieces, each piece
+ * is deflated by a forked worker with the preceding WSIZE bytes
+ * of input as its dictionary, and the results are concatenated in order.
+ * Every piece ends with an empty stored block, which byte-aligns it.
+ */
+#define PAR_BLOCK (128 * 1024)
+/* -p N is capped: N blocks are buffered, N workers are forked */
+#define PAR_MAX_PROCS 256
+/* Worst case output of one piece: stored blocks cost 5 bytes each
+ * and are not emitted more often than every 4k of input.
+ * First 4 bytes of a slot hold the length of the output.
+ */
+#define PAR_SLOT  (4 + PAR_BLOCK + PAR_BLOCK / 512 + 64)
+
+static void par_deflate_block(const uch *dict, unsigned dlen,
+		const uch *buf, unsigned len, uch *slot)
+{
+	IPos hash_head;
+	unsigned j;
+
+	G1.par_in = buf;
+	G1.par_inleft = len;
+	G1.par_out = slot + 4;
+	G1.par_outleft = PAR_SLOT - 4;
+
+	bi_init();
+	memset(head, 0, HASH_SIZE * sizeof(*head));
+	memcpy(G1.window, dict, dlen);
+	G1.strstart = dlen;
+	G1.block_start = dlen;
+	G1.eofile = 0;
+	G1.lookahead = file_read(G1.window + dlen, WINDOW_SIZE - dlen);
+	while (G1.lookahead < MIN_LOOKAHEAD && !G1.eofile)
+		fill_window();
+
+	/* Prime hash chains with the dictionary */
+	G1.ins_h = 0;
+	for (j = 0; j < MIN_MATCH - 1; j++)
+		UPDATE_HASH(G1.ins_h, G1.window[j]);
+	for (j = 0; j < dlen; j++)
+		INSERT_STRING(j, hash_head);
+
+	deflate(0);
+	/* Sync flush: empty stored block aligns output on a byte boundary */
+	send_bits(STORED_BLOCK << 1, 3);
+	copy_block(NULL, 0, 1);
+	flush_outbuf();
+
+	*(uint32_t *)slot = (PAR_SLOT - 4) - G1.par_outleft;
+}
+
+static void zip_parallel(void)
+{
+	unsigned nproc = G1.nproc;
+	unsigned dlen = 0;
+	pid_t *pids = xmalloc(nproc * sizeof(pids[0]));
+	/* WSIZE bytes of dictionary, followed by nproc blocks */
+	uch *inbuf = xmalloc(WSIZE + nproc * PAR_BLOCK);
+	uch *slots = mmap(NULL, nproc * PAR_SLOT, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (slots == MAP_FAILED)
+		bb_perror_msg_and_die("mmap");
+
+	G1.outcnt = 0;
+	put_32bit(0x00088b1f);
+	put_32bit(0);		/* Unix timestamp */
+	put_8bit(2);		/* extra flags, same as lm_init() sets */
+	put_8bit(3);		/* OS identifier = 3 (Unix) */
+	/* Children inherit outbuf: must be empty at fork */
+	flush_outbuf();
+
+	G1.crc = ~0;
+	bi_init();
+	ct_init();
+
+	for (;;) {
+		uch *data = inbuf + WSIZE;
+		ssize_t total;
+		unsigned i, n;
+
+		total = full_read(ifd, data, nproc * PAR_BLOCK);
+		if (total < 0)
+			bb_perror_msg_and_die(bb_msg_read_error);
+		if (total == 0)
+			break;
+
+		n = (total + PAR_BLOCK - 1) / PAR_BLOCK;
+		for (i = 0; i < n; i++) {
+			pids[i] = xfork();
+			if (pids[i] == 0) {
+				uch *blk = data + i * PAR_BLOCK;
+				unsigned dl = (i == 0) ? dlen : WSIZE;
+
+				par_deflate_block(blk - dl, dl, blk,
+					MIN(PAR_BLOCK, total - i * PAR_BLOCK),
+					slots + i * PAR_SLOT);
+				_exit(EXIT_SUCCESS);
+			}
+		}
+
+		/* While workers run, account for the input */
+		updcrc(data, total);
+		G1.isize += total;
+
+		for (i = 0; i < n; i++) {
+			if (wait4pid(pids[i]) != 0)
+				bb_error_msg_and_die("worker process failed");
+		}
+		for (i = 0; i < n; i++) {
+			uch *slot = slots + i * PAR_SLOT;
+			xwrite(ofd, slot + 4, *(uint32_t *)slot);
+		}
+
+		/* Last WSIZE bytes of what we have become the next dictionary */
+		dlen = MIN(dlen + total, WSIZE);
+		memmove(inbuf + WSIZE - dlen, data + total - dlen, dlen);
+
+		if (total != nproc * PAR_BLOCK)
+			break; /* EOF */
+	}
+
+	/* Final block: empty block with static trees, i.e. just END_BLOCK */
+	send_bits((STATIC_TREES << 1) + 1, 3);
+	send_bits(0, 7);
+	bi_windup();
+
+	put_32bit(~G1.crc);
+	put_32bit(G1.isize);
+	flush_outbuf();
+
+	munmap(slots, nproc * PAR_SLOT);
+	free(inbuf);
+	free(pids);
+}
+#endif
+
 
 /* ======================================================================== */
 static
@@ -2143,7 +2329,12 @@ IF_DESKTOP(long long) int FAST_FUNC pack_gzip(transformer_state_t *xstate UNUSED
 	fstat(STDIN_FILENO, &s);
 	zip(s.st_ctime);
 #else
-	zip();
+# if ENABLE_FEATURE_GZIP_PARALLEL
+	if (G1.nproc)
+		zip_parallel();
+	else
+# endif
+		zip();
 #endif
 	return 0;
 }
@@ -2163,6 +2354,9 @@ static const char gzip_longopts[] ALIGN1 =
 	"fast\0"                No_argument       "1"
 	"best\0"                No_argument       "9"
 	"no-name\0"             No_argument       "n"
+#if ENABLE_FEATURE_GZIP_PARALLEL
+	"processes\0"           Required_argument "p"
+#endif
 	;
 #endif
 
@@ -2188,6 +2382,7 @@ int gzip_main(int argc UNUSED_PARAM, char **argv)
 #endif
 {
 	unsigned opt;
+	IF_FEATURE_GZIP_PARALLEL(const char *p_str;)
 #ifdef ENABLE_FEATURE_GZIP_LEVELS
 	static const struct {
 		uint8_t good;
@@ -2211,13 +2406,16 @@ int gzip_main(int argc UNUSED_PARAM, char **argv)
 	applet_long_options = gzip_longopts;
 #endif
 	/* Must match bbunzip's constants OPT_STDOUT, OPT_FORCE! */
-	opt = getopt32(argv, "cfv" IF_GUNZIP("dt") "qn123456789");
+	opt = getopt32(argv, "cfv" IF_GUNZIP("dt") "qn123456789" IF_FEATURE_GZIP_PARALLEL("p:")
+			IF_FEATURE_GZIP_PARALLEL(, &p_str)
+	);
 #if ENABLE_GUNZIP /* gunzip_main may not be visible... */
 	if (opt & 0x18) // -d and/or -t
 		return gunzip_main(argc, argv);
 #endif
 #ifdef ENABLE_FEATURE_GZIP_LEVELS
 	opt >>= ENABLE_GUNZIP ? 7 : 5; /* drop cfv[dt]qn bits */
+	opt &= 0x1ff; /* drop -p bit */
 	if (opt == 0)
 		opt = 1 << 6; /* default: 6 */
 	opt = ffs(opt >> 4); /* Maps -1..-4 to [0], -5 to [1] ... -9 to [5] */
@@ -2225,6 +2423,15 @@ int gzip_main(int argc UNUSED_PARAM, char **argv)
 	good_match	 = gzip_level_config[opt].good;
 	max_lazy_match	 = gzip_level_config[opt].lazy2 * 2;
 	nice_match	 = gzip_level_config[opt].nice2 * 2;
+#endif
+#if ENABLE_FEATURE_GZIP_PARALLEL
+	if (option_mask32 & (1 << (ENABLE_GUNZIP ? 16 : 14))) {
+		G1.nproc = xatou_range(p_str, 0, PAR_MAX_PROCS);
+		if (G1.nproc == 0)
+			G1.nproc = MIN(get_cpu_count(), PAR_MAX_PROCS);
+		if (G1.nproc == 1) /* not worth it */
+			G1.nproc = 0;
+	}
 #endif
 	option_mask32 &= 0x7; /* retain only -cfv */
 
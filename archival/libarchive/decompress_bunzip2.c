@@ -560,6 +560,11 @@ int FAST_FUNC read_bunzip(bunzip_data *bd, char *outbuf, int len)
 	/* We will always have pending decoded data to write into the output
 	   buffer unless this is the very first call (in which case we haven't
 	   Huffman-decoded a block into the intermediate buffer yet). */
+#if ENABLE_FEATURE_BUNZIP2_PARALLEL
+	/* ...or the caller has done it already, see par_decode_block() */
+	if (!bd->writeCopies && bd->writeCount > 0)
+		goto got_block;
+#endif
 	if (bd->writeCopies) {
 
  dec_writeCopies:
@@ -641,6 +646,9 @@ int FAST_FUNC read_bunzip(bunzip_data *bd, char *outbuf, int len)
 		}
 	}
 
+#if ENABLE_FEATURE_BUNZIP2_PARALLEL
+ got_block:
+#endif
 	CRC = ~0;
 	pos = bd->writePos;
 	current = bd->writeCurrent;
@@ -729,6 +737,321 @@ void FAST_FUNC dealloc_bunzip(bunzip_data *bd)
 }
 
 
+#if ENABLE_FEATURE_BUNZIP2_PARALLEL
+/* Parallel decoding.
+ *
+ * Blocks start with a 48-bit magic at arbitrary bit positions. We scan
+ * the input buffer for it and start a worker at every match. The magic
+ * can occur inside compressed data too, so some workers decode garbage.
+ * That does not matter: a worker reports where its block ended,
+ * and the parent uses only the chain of blocks which starts where
+ * the previous true block ended.
+ */
+#define BLOCK_MAGIC 0x314159265359ULL
+#define EOS_MAGIC   0x177245385090ULL
+
+struct par_result {
+	int status;          /* RETVAL_xxx */
+	uint32_t crc;        /* block CRC from block header */
+	unsigned long end;   /* bit position right after the block */
+	unsigned long len;   /* number of decoded bytes which follow */
+};
+
+/* Return 48 bits at bit position pos (big endian, as get_bits reads them).
+ * Caller ensures there are 7 readable bytes at pos / 8.
+ */
+static uint64_t peek48(const uint8_t *buf, unsigned long pos)
+{
+	const uint8_t *p = buf + (pos >> 3);
+	uint64_t v = 0;
+	int i;
+
+	for (i = 0; i < 7; i++)
+		v = (v << 8) | p[i];
+	return (v >> (8 - (pos & 7))) & 0xffffffffffffULL;
+}
+
+/* Find block magics after pos, up to max of them, stop at end of stream */
+static unsigned find_blocks(const uint8_t *buf, unsigned have,
+		unsigned long pos, unsigned long *cand, unsigned max)
+{
+	unsigned n = 0;
+	unsigned i = pos >> 3;
+	uint64_t v = 0;
+
+	if (have < 6)
+		return 0;
+	/* v accumulates bytes; after adding byte i, it ends at bit (i+1)*8 */
+	while (i < have) {
+		int sh;
+
+		v = (v << 8) | buf[i++];
+		for (sh = 7; sh >= 0; sh--) {
+			uint64_t m = (v >> sh) & 0xffffffffffffULL;
+			unsigned long end = (unsigned long)i * 8 - sh;
+
+			if (end <= pos + 48)
+				continue;
+			if (m == EOS_MAGIC)
+				return n;
+			if (m == BLOCK_MAGIC) {
+				cand[n++] = end - 48;
+				if (n == max)
+					return n;
+			}
+		}
+	}
+	return n;
+}
+
+/* Runs in a worker: decode one block at bit position bitpos of buf,
+ * write struct par_result and decoded data to fd.
+ */
+static void par_decode_block(uint8_t *buf, unsigned have,
+		unsigned long bitpos, unsigned dbufSize, int fd)
+{
+	struct par_result res;
+	uint8_t trailer[10];
+	bunzip_data *bd;
+	char *out = NULL;
+	unsigned long outlen = 0, outsize = 0;
+	int r;
+
+	memset(&res, 0, sizeof(res));
+	bd = xzalloc(sizeof(*bd));
+	bd->in_fd = -1;
+	bd->inbuf = buf;
+	bd->inbufCount = have;
+	bd->inbufPos = bitpos >> 3;
+	if (bitpos & 7) {
+		bd->inbufBits = buf[bd->inbufPos++];
+		bd->inbufBitCount = 8 - (bitpos & 7);
+	}
+	crc32_filltable(bd->crc32Table, 1);
+	bd->dbufSize = dbufSize;
+	bd->dbuf = xmalloc(dbufSize * sizeof(bd->dbuf[0]));
+
+	r = setjmp(bd->jmpbuf);
+	if (r == 0)
+		r = get_next_block(bd);
+	if (r == 0) {
+		res.end = (unsigned long)bd->inbufPos * 8 - bd->inbufBitCount;
+		res.crc = bd->headerCRC;
+		/* Make read_bunzip() find end of stream right after this block,
+		 * with "combined" CRC equal to the block CRC */
+		trailer[0] = 0x17; trailer[1] = 0x72; trailer[2] = 0x45;
+		trailer[3] = 0x38; trailer[4] = 0x50; trailer[5] = 0x90;
+		trailer[6] = res.crc >> 24; trailer[7] = res.crc >> 16;
+		trailer[8] = res.crc >> 8; trailer[9] = res.crc;
+		bd->inbuf = trailer;
+		bd->inbufPos = 0;
+		bd->inbufCount = sizeof(trailer);
+		bd->inbufBitCount = 0;
+		for (;;) {
+			if (outlen == outsize) {
+				outsize += dbufSize;
+				out = xrealloc(out, outsize);
+			}
+			r = read_bunzip(bd, out + outlen, outsize - outlen);
+			if (r == 0) { /* buffer is full */
+				outlen = outsize;
+				continue;
+			}
+			if (r > 0)
+				outlen = outsize - r;
+			else if (r != RETVAL_LAST_BLOCK)
+				break; /* error */
+			/* EOF */
+			r = RETVAL_OK;
+			if (bd->headerCRC != bd->totalCRC)
+				r = RETVAL_LAST_BLOCK; /* "CRC error" */
+			break;
+		}
+	}
+	res.status = r;
+	res.len = outlen;
+	/* Parent may be not interested and close the pipe: no xwrite */
+	if (full_write(fd, &res, sizeof(res)) == sizeof(res))
+		full_write(fd, out, outlen);
+}
+
+#define PAR_MAX_PROCS     256
+#define PAR_DEFAULT_PROCS 16
+
+static IF_DESKTOP(long long) int
+unpack_bz2_stream_parallel(transformer_state_t *xstate, unsigned nproc)
+{
+	IF_DESKTOP(long long total_written = 0;)
+	unsigned long *cand = xmalloc(nproc * sizeof(cand[0]));
+	pid_t *pids = xmalloc(nproc * sizeof(pids[0]));
+	int *fds = xmalloc(nproc * sizeof(fds[0]));
+	/* nproc <= PAR_MAX_PROCS: no overflow */
+	size_t cap = (size_t)nproc * 1024 * 1024;
+	uint8_t *buf = xmalloc(cap + 8);
+	unsigned have = 0;
+	unsigned long pos = 0; /* bit position of next header in buf */
+	unsigned dbufSize = 0; /* 0: expecting "hN" stream header */
+	smallint need_BZ = 0;  /* expecting "BZ" of next stream, or end */
+	smallint eof = 0;
+	uint32_t totalCRC = 0;
+	int retval = RETVAL_OK;
+
+	for (;;) {
+		unsigned i, n;
+		uint64_t magic;
+
+		/* Drop consumed bytes, refill */
+		i = pos >> 3;
+		have -= i;
+		memmove(buf, buf + i, have);
+		pos &= 7;
+		if (!eof && have < cap) {
+			ssize_t r = full_read(xstate->src_fd, buf + have, cap - have);
+			if (r < 0) {
+				bb_perror_msg(bb_msg_read_error);
+				retval = -1;
+				goto ret;
+			}
+			if (r != (ssize_t)(cap - have))
+				eof = 1;
+			have += r;
+		}
+		memset(buf + have, 0, 8); /* peek48 may look past data */
+
+		if (need_BZ) {
+			/* Do we have "BZ..." after this stream?
+			 * pbzip2 (parallelized bzip2) produces such files.
+			 */
+			if (have < 2 || buf[0] != 'B' || buf[1] != 'Z')
+				break;
+			pos = 16;
+			need_BZ = 0;
+			continue;
+		}
+		if (dbufSize == 0) {
+			if (have < 2 || buf[0] != 'h' || (unsigned)(buf[1] - '1') >= 9) {
+				retval = RETVAL_NOT_BZIP_DATA;
+				goto err;
+			}
+			dbufSize = 100000 * (buf[1] - '0');
+			totalCRC = 0;
+			pos = 16;
+		}
+
+		if (pos + 48 > (unsigned long)have * 8) {
+			retval = RETVAL_UNEXPECTED_INPUT_EOF;
+			goto err;
+		}
+		magic = peek48(buf, pos);
+		if (magic == EOS_MAGIC) {
+			if (pos + 48 + 32 > (unsigned long)have * 8) {
+				retval = RETVAL_UNEXPECTED_INPUT_EOF;
+				goto err;
+			}
+			if ((uint32_t)(peek48(buf, pos + 48) >> 16) != totalCRC) {
+				bb_error_msg("CRC error");
+				retval = -1;
+				goto ret;
+			}
+			/* Stream is padded to byte boundary */
+			pos = (pos + 48 + 32 + 7) & ~7UL;
+			dbufSize = 0;
+			need_BZ = 1;
+			continue;
+		}
+		if (magic != BLOCK_MAGIC) {
+			retval = RETVAL_NOT_BZIP_DATA;
+			goto err;
+		}
+
+		cand[0] = pos;
+		n = 1 + find_blocks(buf, have, pos, cand + 1, nproc - 1);
+		for (i = 0; i < n; i++) {
+			struct fd_pair fd_pipe;
+
+			xpiped_pair(fd_pipe);
+			pids[i] = xfork();
+			if (pids[i] == 0) {
+				unsigned k;
+				/* Not holding other pipes open: parent closing
+				 * a pipe must be able to kill its worker */
+				for (k = 0; k < i; k++)
+					close(fds[k]);
+				close(fd_pipe.rd);
+				par_decode_block(buf, have, cand[i], dbufSize, fd_pipe.wr);
+				_exit(EXIT_SUCCESS);
+			}
+			close(fd_pipe.wr);
+			fds[i] = fd_pipe.rd;
+		}
+
+		/* Collect results: only the chain starting at pos is used */
+		for (i = 0; i < n; i++) {
+			struct par_result res;
+
+			if (cand[i] != pos || retval != RETVAL_OK)
+				continue;
+			if (full_read(fds[i], &res, sizeof(res)) != sizeof(res)) {
+				bb_error_msg_and_die("worker process failed");
+			}
+			if (res.status == RETVAL_UNEXPECTED_INPUT_EOF && !eof) {
+				/* Block did not fit, read more. Need bigger buffer? */
+				if (pos < 8 && have == cap) {
+					/* Bit positions in it must fit in unsigned.
+					 * (Valid blocks are < 1M: it's not bzip2 data) */
+					if (cap > UINT_MAX / 8 / 2) {
+						retval = RETVAL_NOT_BZIP_DATA;
+						break;
+					}
+					cap *= 2;
+					buf = xrealloc(buf, cap + 8);
+				}
+				break;
+			}
+			if (res.status != RETVAL_OK) {
+				retval = res.status;
+				break;
+			}
+			while (res.len != 0) {
+				char tmp[IOBUF_SIZE];
+				ssize_t r = safe_read(fds[i], tmp, MIN(res.len, sizeof(tmp)));
+				if (r <= 0)
+					bb_error_msg_and_die("worker process failed");
+				if (transformer_write(xstate, tmp, r) != r) {
+					retval = RETVAL_SHORT_WRITE;
+					break;
+				}
+				IF_DESKTOP(total_written += r;)
+				res.len -= r;
+			}
+			totalCRC = ((totalCRC << 1) | (totalCRC >> 31)) ^ res.crc;
+			pos = res.end;
+		}
+		/* Workers we did not listen to die of SIGPIPE */
+		for (i = 0; i < n; i++) {
+			close(fds[i]);
+			safe_waitpid(pids[i], NULL, 0);
+		}
+		if (retval != RETVAL_OK)
+			goto err;
+	}
+	goto ret;
+
+ err:
+	if (retval == RETVAL_LAST_BLOCK)
+		bb_error_msg("CRC error");
+	else if (retval != RETVAL_SHORT_WRITE)
+		bb_error_msg("bunzip error %d", retval);
+	retval = -1;
+ ret:
+	free(buf);
+	free(fds);
+	free(pids);
+	free(cand);
+	return retval ? retval : IF_DESKTOP(total_written) + 0;
+}
+#endif
+
 /* Decompress src_fd to dst_fd.  Stops at end of bzip data, not end of file. */
 IF_DESKTOP(long long) int FAST_FUNC
 unpack_bz2_stream(transformer_state_t *xstate)
@@ -742,6 +1065,17 @@ unpack_bz2_stream(transformer_state_t *xstate)
 	if (check_signature16(xstate, BZIP2_MAGIC))
 		return -1;
 
+#if ENABLE_FEATURE_BUNZIP2_PARALLEL
+	{
+		char *p = getenv("BUNZIP2_PROCS");
+		unsigned nproc = p ? xatou_range(p, 1, PAR_MAX_PROCS)
+			/* each worker costs 1M of input buffer */
+			: MIN(get_cpu_count(), PAR_DEFAULT_PROCS);
+		if (nproc > 1)
+			return unpack_bz2_stream_parallel(xstate, nproc);
+	}
+#endif
+
 	outbuf = xmalloc(IOBUF_SIZE);
 	len = 0;
 	while (1) { /* "Process one BZ... stream" loop */
@@ -508,6 +508,125 @@ static void inflate_codes_setup(STATE_PARAM unsigned my_bl, unsigned my_bd)
 	ml = mask_bits[bl];		/* precompute masks for speed */
 	md = mask_bits[bd];
 }
+#if ENABLE_FEATURE_GUNZIP_FAST_INFLATE
+/* Decode symbols while there is enough slack in both buffers
+ * that no bounds checks are needed inside the loop:
+ * one length/distance pair takes at most 15+5+15+13 = 48 bits,
+ * and the bit buffer is topped up to >= 56 bits by one 8-byte load.
+ * Matches are copied 8 bytes at a time and may overrun by 7 bytes.
+ * Returns 1 if end of block was seen, 0 if slow path must take over.
+ */
+enum {
+	FAST_IN_SLACK = 8,
+	FAST_OUT_SLACK = 258 + 8,
+};
+static int inflate_codes_fast(STATE_PARAM_ONLY)
+{
+	unsigned char *const win = gunzip_window;
+	const unsigned char *const in_start = bytebuffer + bytebuffer_offset;
+	const unsigned char *const in_end = bytebuffer + bytebuffer_size;
+	const unsigned char *in = in_start;
+	uint64_t b64 = bb;
+	unsigned nbits = k;
+	unsigned wp = w;
+	unsigned n;
+	int eob = 0;
+
+	while (in_end - in >= FAST_IN_SLACK && wp <= GUNZIP_WSIZE - FAST_OUT_SLACK) {
+		huft_t *t;
+		unsigned e, len, dist;
+		uint64_t v;
+
+		/* Bits above nbits are already the next bits of input,
+		 * so ORing them in again is harmless */
+		memcpy(&v, in, 8);
+		b64 |= SWAP_LE64(v) << nbits;
+		in += (63 - nbits) >> 3;
+		nbits |= 56;
+
+		t = tl + ((unsigned) b64 & ml);
+		e = t->e;
+		while (e > 16) {
+			if (e == 99)
+				abort_unzip(PASS_STATE_ONLY);
+			b64 >>= t->b;
+			nbits -= t->b;
+			e -= 16;
+			t = t->v.t + ((unsigned) b64 & mask_bits[e]);
+			e = t->e;
+		}
+		b64 >>= t->b;
+		nbits -= t->b;
+		if (e == 16) {	/* literal */
+			win[wp++] = (unsigned char) t->v.n;
+			continue;
+		}
+		if (e == 15) {	/* end of block */
+			eob = 1;
+			break;
+		}
+		len = t->v.n + ((unsigned) b64 & mask_bits[e]);
+		b64 >>= e;
+		nbits -= e;
+
+		t = td + ((unsigned) b64 & md);
+		e = t->e;
+		while (e > 16) {
+			if (e == 99)
+				abort_unzip(PASS_STATE_ONLY);
+			b64 >>= t->b;
+			nbits -= t->b;
+			e -= 16;
+			t = t->v.t + ((unsigned) b64 & mask_bits[e]);
+			e = t->e;
+		}
+		b64 >>= t->b;
+		nbits -= t->b;
+		dist = t->v.n + ((unsigned) b64 & mask_bits[e]);
+		b64 >>= e;
+		nbits -= e;
+
+		if (dist > wp) {
+			/* source wraps around to the end of the window */
+			unsigned src = wp - dist;
+			do {
+				win[wp++] = win[src++ & (GUNZIP_WSIZE - 1)];
+			} while (--len);
+		} else if (dist >= 8) {
+			unsigned char *dst = win + wp;
+			const unsigned char *src = dst - dist;
+			wp += len;
+			do {
+				memcpy(dst, src, 8);
+				dst += 8;
+				src += 8;
+			} while (dst < win + wp);
+		} else if (dist == 1) {
+			memset(win + wp, win[wp - 1], len);
+			wp += len;
+		} else {
+			do {
+				win[wp] = win[wp - dist];
+				wp++;
+			} while (--len);
+		}
+	}
+
+	/* Return whole unused bytes to the input buffer. Bytes which were
+	 * in the bit buffer before we started stay there, so that
+	 * no more than 32 bits remain */
+	n = nbits >> 3;
+	if (n > in - in_start)
+		n = in - in_start;
+	in -= n;
+	nbits -= n * 8;
+	bytebuffer_offset = in - bytebuffer;
+	bb = b64 & (((uint64_t)1 << nbits) - 1);
+	k = nbits;
+	w = wp;
+	return eob;
+}
+#endif
 /* called once from inflate_get_next_window */
 static NOINLINE int inflate_codes(STATE_PARAM_ONLY)
 {
@@ -518,6 +637,10 @@ static NOINLINE int inflate_codes(STATE_PARAM_ONLY)
 		goto do_copy;
 
 	while (1) {			/* do until end of block */
+#if ENABLE_FEATURE_GUNZIP_FAST_INFLATE
+		if (inflate_codes_fast(PASS_STATE_ONLY))
+			break;
+#endif
 		bb = fill_bitbuffer(PASS_STATE bb, &k, bl);
 		t = tl + ((unsigned) bb & ml);
 		e = t->e;
@@ -32,6 +32,9 @@
 //usage:     "\n	-i	Prompt before overwrite"
 //usage:     "\n	-l,-s	Create (sym)links"
 //usage:     "\n	-u	Copy only newer files"
+//usage:	IF_FEATURE_CP_PARALLEL(
+//usage:     "\n	--parallel N	Copy files in N processes (0: one per CPU)"
+//usage:	)
 
 #include "libbb.h"
 #include "libcoreutils/coreutils.h"
@@ -49,11 +52,16 @@ int cp_main(int argc, char **argv)
 	int d_flags;
 	int flags;
 	int status;
+	IF_FEATURE_CP_PARALLEL(const char *nproc_str = NULL;)
+	IF_FEATURE_CP_PARALLEL(unsigned nproc;)
 	enum {
 		FILEUTILS_CP_OPTNUM = sizeof(FILEUTILS_CP_OPTSTR)-1,
 #if ENABLE_FEATURE_CP_LONG_OPTIONS
 		/*OPT_rmdest  = FILEUTILS_RMDEST = 1 << FILEUTILS_CP_OPTNUM */
 		OPT_parents = 1 << (FILEUTILS_CP_OPTNUM+1),
+#endif
+#if ENABLE_FEATURE_CP_PARALLEL
+		OPT_parallel = 1 << (FILEUTILS_CP_OPTNUM+2),
 #endif
 	};
 
@@ -78,9 +86,12 @@ int cp_main(int argc, char **argv)
 		"update\0"         No_argument "u"
 		"remove-destination\0" No_argument "\xff"
 		"parents\0"        No_argument "\xfe"
+		IF_FEATURE_CP_PARALLEL(
+		"parallel\0"       Required_argument "\xfd"
+		)
 		;
 #endif
-	flags = getopt32(argv, FILEUTILS_CP_OPTSTR);
+	flags = getopt32(argv, FILEUTILS_CP_OPTSTR IF_FEATURE_CP_PARALLEL(, &nproc_str));
 	/* Options of cp from GNU coreutils 6.10:
 	 * -a, --archive
 	 * -f, --force
@@ -143,6 +154,18 @@ int cp_main(int argc, char **argv)
 		selinux_or_die();
 	}
 #endif
+#if ENABLE_FEATURE_CP_PARALLEL
+	nproc = 1;
+	if (flags & OPT_parallel) {
+		nproc = xatou(nproc_str);
+		if (nproc == 0)
+			nproc = get_cpu_count();
+	}
+	flags &= ~OPT_parallel;
+	/* -i asks questions, -v would print in different order */
+	if (nproc > 1 && !(flags & (FILEUTILS_INTERACTIVE | FILEUTILS_VERBOSE)))
+		flags |= FILEUTILS_PARALLEL;
+#endif
 
 	status = EXIT_SUCCESS;
 	last = argv[argc - 1];
@@ -200,6 +223,11 @@ int cp_main(int argc, char **argv)
 		if (copy_file(*argv, dest, flags) < 0) {
 			status = EXIT_FAILURE;
 		}
+#if ENABLE_FEATURE_CP_PARALLEL
+		if ((flags & FILEUTILS_PARALLEL) && copy_file_deferred(nproc) < 0) {
+			status = EXIT_FAILURE;
+		}
+#endif
 		if (*++argv == last) {
 			/* possibly leaking dest... */
 			break;
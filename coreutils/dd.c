@@ -46,6 +46,18 @@
 //config:	  Enables support for writing a certain number of bytes in and out,
 //config:	  at a time, and performing conversions on the data stream.
 //config:
+//config:config FEATURE_DD_URING
+//config:	bool "Enable oflag=uring: keep several blocks in flight"
+//config:	default y
+//config:	depends on DD && FEATURE_DD_IBS_OBS
+//config:	select PLATFORM_LINUX
+//config:	help
+//config:	  With oflag=uring, dd reads and writes up to 16 blocks at once
+//config:	  via io_uring, overlapping reads with writes. Helps with small
+//config:	  block sizes on fast devices, especially with iflag=direct
+//config:	  and oflag=direct. Needs Linux 5.1+, without io_uring
+//config:	  (or for pipes, or with conversions) dd works as usual.
+//config:
 //config:config FEATURE_DD_STATUS
 //config:	bool "Enable status display options"
 //config:	default y
@@ -55,7 +67,8 @@
 
 //usage:#define dd_trivial_usage
 //usage:       "[if=FILE] [of=FILE] " IF_FEATURE_DD_IBS_OBS("[ibs=N] [obs=N] ") "[bs=N] [count=N] [skip=N]\n"
-//usage:       "	[seek=N]" IF_FEATURE_DD_IBS_OBS(" [conv=notrunc|noerror|sync|fsync] [iflag=skip_bytes]")
+//usage:       "	[seek=N]" IF_FEATURE_DD_IBS_OBS(" [conv=notrunc|noerror|sync|fsync|sparse]\n"
+//usage:       "	[iflag=skip_bytes|direct] [oflag=direct" IF_FEATURE_DD_URING("|uring") "]")
 //usage:#define dd_full_usage "\n\n"
 //usage:       "Copy a file with converting and formatting\n"
 //usage:     "\n	if=FILE		Read from FILE instead of stdin"
@@ -76,7 +89,13 @@
 //usage:     "\n	conv=sync	Pad blocks with zeros"
 //usage:     "\n	conv=fsync	Physically write data out before finishing"
 //usage:     "\n	conv=swab	Swap every pair of bytes"
+//usage:     "\n	conv=sparse	Seek rather than write blocks of zeros"
 //usage:     "\n	iflag=skip_bytes	skip=N is in bytes"
+//usage:     "\n	iflag=direct	Read with O_DIRECT"
+//usage:     "\n	oflag=direct	Write with O_DIRECT"
+//usage:	IF_FEATURE_DD_URING(
+//usage:     "\n	oflag=uring	Keep many reads/writes in flight (io_uring)"
+//usage:	)
 //usage:	)
 //usage:	IF_FEATURE_DD_STATUS(
 //usage:     "\n	status=noxfer	Suppress rate output"
@@ -108,6 +127,13 @@ struct globals {
 	unsigned long long begin_time_us;
 #endif
 	int flags;
+#if ENABLE_FEATURE_DD_IBS_OBS
+	bool out_hole; /* last output block was skipped by conv=sparse */
+#endif
+#if ENABLE_FEATURE_DD_URING
+	/* to report average queue depth */
+	unsigned long long uring_ops, uring_depth_sum;
+#endif
 } FIX_ALIASING;
 #define G (*(struct globals*)bb_common_bufsiz1)
 #define INIT_G() do { \
@@ -124,16 +150,23 @@ enum {
 	FLAG_NOERROR = (1 << 2) * ENABLE_FEATURE_DD_IBS_OBS,
 	FLAG_FSYNC   = (1 << 3) * ENABLE_FEATURE_DD_IBS_OBS,
 	FLAG_SWAB    = (1 << 4) * ENABLE_FEATURE_DD_IBS_OBS,
+	FLAG_SPARSE  = (1 << 5) * ENABLE_FEATURE_DD_IBS_OBS,
 	/* end of conv flags */
 	/* start of input flags */
-	FLAG_IFLAG_SHIFT = 5,
-	FLAG_SKIP_BYTES = (1 << 5) * ENABLE_FEATURE_DD_IBS_OBS,
+	FLAG_IFLAG_SHIFT = 6,
+	FLAG_SKIP_BYTES = (1 << 6) * ENABLE_FEATURE_DD_IBS_OBS,
+	FLAG_IDIRECT    = (1 << 7) * ENABLE_FEATURE_DD_IBS_OBS,
 	/* end of input flags */
-	FLAG_TWOBUFS = (1 << 6) * ENABLE_FEATURE_DD_IBS_OBS,
-	FLAG_COUNT   = 1 << 7,
-	FLAG_STATUS  = 1 << 8,
-	FLAG_STATUS_NONE = 1 << 9,
-	FLAG_STATUS_NOXFER = 1 << 10,
+	/* start of output flags */
+	FLAG_OFLAG_SHIFT = 8,
+	FLAG_ODIRECT    = (1 << 8) * ENABLE_FEATURE_DD_IBS_OBS,
+	FLAG_URING      = (1 << 9) * ENABLE_FEATURE_DD_URING,
+	/* end of output flags */
+	FLAG_TWOBUFS = (1 << 10) * ENABLE_FEATURE_DD_IBS_OBS,
+	FLAG_COUNT   = 1 << 11,
+	FLAG_STATUS  = 1 << 12,
+	FLAG_STATUS_NONE = 1 << 13,
+	FLAG_STATUS_NOXFER = 1 << 14,
 };
 
 static void dd_output_status(int UNUSED_PARAM cur_signal)
@@ -149,6 +182,12 @@ static void dd_output_status(int UNUSED_PARAM cur_signal)
 			"%"OFF_FMT"u+%"OFF_FMT"u records out\n",
 			G.in_full, G.in_part,
 			G.out_full, G.out_part);
+#if ENABLE_FEATURE_DD_URING
+	if (G.uring_ops) {
+		unsigned qd10 = G.uring_depth_sum * 10 / G.uring_ops;
+		fprintf(stderr, "%u.%u average queue depth\n", qd10 / 10, qd10 % 10);
+	}
+#endif
 
 #if ENABLE_FEATURE_DD_THIRD_STATUS_LINE
 # if ENABLE_FEATURE_DD_STATUS
@@ -179,6 +218,15 @@ static void dd_output_status(int UNUSED_PARAM cur_signal)
 #endif
 }
 
+#if ENABLE_FEATURE_DD_IBS_OBS
+static void set_direct(int fd, int on, const char *filename)
+{
+	int fl = fcntl(fd, F_GETFL);
+	if (fcntl(fd, F_SETFL, on ? (fl | O_DIRECT) : (fl & ~O_DIRECT)) < 0)
+		bb_perror_msg_and_die("can't set O_DIRECT on '%s'", filename);
+}
+#endif
+
 static ssize_t full_write_or_warn(const void *buf, size_t len,
 	const char *const filename)
 {
@@ -191,7 +239,25 @@ static ssize_t full_write_or_warn(const void *buf, size_t len,
 static bool write_and_stats(const void *buf, size_t len, size_t obs,
 	const char *filename)
 {
-	ssize_t n = full_write_or_warn(buf, len, filename);
+	ssize_t n;
+
+#if ENABLE_FEATURE_DD_IBS_OBS
+	/* Last, partial block can't be written with O_DIRECT */
+	if ((G.flags & FLAG_ODIRECT) && len != obs) {
+		G.flags &= ~FLAG_ODIRECT;
+		set_direct(ofd, 0, filename);
+	}
+	G.out_hole = 0;
+	if ((G.flags & FLAG_SPARSE)
+	 && len != 0 && ((const char*)buf)[0] == '\0'
+	 && memcmp(buf, (const char*)buf + 1, len - 1) == 0
+	 && lseek(ofd, len, SEEK_CUR) >= 0 /* (fails if not seekable) */
+	) {
+		G.out_hole = 1;
+		n = len;
+	} else
+#endif
+	n = full_write_or_warn(buf, len, filename);
 	if (n < 0)
 		return 1;
 	if ((size_t)n == obs)
@@ -204,6 +270,309 @@ static bool write_and_stats(const void *buf, size_t len, size_t obs,
 	return 0;
 }
 
+#if ENABLE_FEATURE_DD_URING
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* Up to URING_DEPTH blocks are being read or written at once.
+ * Block k is read from in_pos + k*bs and, when the read completes,
+ * written to out_pos + k*bs in the same buffer. When the write
+ * completes, the buffer is reused to read the next block.
+ * A short read means eof: blocks after it read nothing.
+ */
+#define URING_DEPTH 16
+
+struct uring {
+	int fd;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	unsigned to_submit, in_flight;
+};
+
+struct uring_slot {
+	struct iovec iov;
+	off_t block;
+	off_t pos;      /* where to write the rest of the block */
+	char *buf;
+	size_t got;     /* read so far into the block */
+	unsigned depth; /* ops in flight when this one was queued */
+};
+
+static int uring_init(struct uring *r, unsigned entries)
+{
+	struct io_uring_params p;
+	size_t sq_size, cq_size;
+	char *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	r->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0)
+		return -1;
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_size > sq_size)
+			sq_size = cq_size;
+	}
+	sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	cq = sq;
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP))
+		cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+			PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || r->sqes == MAP_FAILED) {
+		close(r->fd);
+		return -1;
+	}
+	r->sq_tail  = (void*)(sq + p.sq_off.tail);
+	r->sq_mask  = (void*)(sq + p.sq_off.ring_mask);
+	r->sq_array = (void*)(sq + p.sq_off.array);
+	r->cq_head  = (void*)(cq + p.cq_off.head);
+	r->cq_tail  = (void*)(cq + p.cq_off.tail);
+	r->cq_mask  = (void*)(cq + p.cq_off.ring_mask);
+	r->cqes     = (void*)(cq + p.cq_off.cqes);
+	r->to_submit = r->in_flight = 0;
+	return 0;
+}
+
+/* user_data: slot number * 2 + is_write */
+static void uring_queue(struct uring *r, int op, int fd,
+		struct uring_slot *sl, unsigned data, off_t pos)
+{
+	unsigned tail = *r->sq_tail;
+	unsigned idx = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = op; /* READV/WRITEV: these work since Linux 5.1 */
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)&sl->iov;
+	sqe->len = 1;
+	sqe->off = pos;
+	sqe->user_data = data;
+	r->sq_array[idx] = idx;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	r->to_submit++;
+	r->in_flight++;
+	sl->depth = r->in_flight;
+}
+
+/* Only ops which transfer data count for average queue depth:
+ * reads past EOF which return 0 do not */
+static void uring_account(struct uring_slot *sl)
+{
+	G.uring_ops++;
+	G.uring_depth_sum += sl->depth;
+}
+
+/* Returns 0 if done, 1 on read error, 2 on write error,
+ * -1 if io_uring can't be used (then nothing is done) */
+static int dd_uring(size_t bs, off_t count, const char *infile, const char *outfile)
+{
+	struct uring r;
+	struct uring_slot slot[URING_DEPTH];
+	off_t in_pos, in_size, out_pos, next_block, eof_block, read_end, written;
+	struct stat st;
+	unsigned depth, i;
+	char *bufs;
+	int err = 0;
+
+	if (G.flags & (FLAG_TWOBUFS | FLAG_SWAB | FLAG_SYNC | FLAG_NOERROR | FLAG_SPARSE))
+		return -1;
+	/* Need to know positions: no pipes, sockets, ttys */
+	in_pos = lseek(ifd, 0, SEEK_CUR);
+	out_pos = lseek(ofd, 0, SEEK_CUR);
+	if (in_pos < 0 || out_pos < 0)
+		return -1;
+	/* Reads are issued ahead at computed offsets: input must be
+	 * a file or a block device. Seekable char devices, /proc and /sys
+	 * files (they have zero size) are read the usual way */
+	if (fstat(ifd, &st) != 0)
+		return -1;
+	if (S_ISREG(st.st_mode) && st.st_size > 0)
+		in_size = st.st_size;
+	else if (S_ISBLK(st.st_mode)) {
+		in_size = lseek(ifd, 0, SEEK_END);
+		if (in_size < 0 || lseek(ifd, in_pos, SEEK_SET) < 0)
+			return -1;
+	} else
+		return -1;
+
+	depth = URING_DEPTH;
+	while (depth > 2 && (bs * depth) > 64 * 1024 * 1024)
+		depth--;
+	/* page-aligned, as O_DIRECT wants */
+	bufs = mmap(NULL, bs * depth, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (bufs == MAP_FAILED)
+		return -1;
+	if (uring_init(&r, depth) < 0) {
+		munmap(bufs, bs * depth);
+		return -1;
+	}
+
+	eof_block = (G.flags & FLAG_COUNT) ? count : (((off_t)1 << (sizeof(off_t)*8 - 2)) / bs);
+	next_block = 0;
+	read_end = written = 0;
+	for (i = 0; i < depth && next_block < eof_block; i++) {
+		slot[i].buf = bufs + i * bs;
+		slot[i].block = next_block++;
+		slot[i].iov.iov_base = slot[i].buf;
+		slot[i].iov.iov_len = bs;
+		slot[i].got = 0;
+		uring_queue(&r, IORING_OP_READV, ifd, &slot[i], i * 2,
+				in_pos + slot[i].block * bs);
+	}
+
+	while (r.in_flight) {
+		unsigned head, tail;
+
+		if (syscall(__NR_io_uring_enter, r.fd, r.to_submit, 1,
+				IORING_ENTER_GETEVENTS, NULL, 0) < 0
+		) {
+			if (errno == EINTR) /* SIGUSR1 */
+				continue;
+			bb_simple_perror_msg_and_die("io_uring_enter");
+		}
+		r.to_submit = 0;
+
+		head = *r.cq_head;
+		tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+			struct uring_slot *sl = &slot[cqe->user_data / 2];
+			int res = cqe->res;
+
+			head++;
+			r.in_flight--;
+			if (!(cqe->user_data & 1)) {
+				/* Read is done */
+				if (res < 0) {
+					if (!err) {
+						errno = -res;
+						bb_simple_perror_msg(infile);
+						err = 1;
+					}
+					continue;
+				}
+				if (sl->block >= eof_block)
+					continue;
+				if (res > 0) {
+					off_t pos;
+
+					uring_account(sl);
+					sl->got += res;
+					pos = in_pos + sl->block * bs + sl->got;
+					if (sl->got != bs && pos < in_size) {
+						/* Short read before end of input
+						 * is not EOF: read the rest */
+						sl->iov.iov_base = sl->buf + sl->got;
+						sl->iov.iov_len = bs - sl->got;
+						if (!err)
+							uring_queue(&r, IORING_OP_READV, ifd, sl, cqe->user_data, pos);
+						continue;
+					}
+				}
+				res = sl->got;
+				if (res == 0) {
+					eof_block = sl->block;
+					continue;
+				}
+				if ((size_t)res == bs)
+					G.in_full++;
+				else {
+					G.in_part++;
+					eof_block = sl->block + 1;
+				}
+				if (read_end < sl->block * bs + res)
+					read_end = sl->block * bs + res;
+				if (err)
+					continue;
+				sl->iov.iov_base = sl->buf;
+				sl->iov.iov_len = res;
+				sl->pos = out_pos + sl->block * bs;
+				if ((G.flags & FLAG_ODIRECT) && (size_t)res != bs) {
+					/* Can't do it with O_DIRECT, do it at the end */
+					continue;
+				}
+				uring_queue(&r, IORING_OP_WRITEV, ofd, sl, cqe->user_data | 1, sl->pos);
+				continue;
+			}
+			/* Write is done */
+			if (res <= 0) {
+				if (!err) {
+					errno = res ? -res : ENOSPC;
+					bb_perror_msg("writing '%s'", outfile);
+					err = 2;
+				}
+				continue;
+			}
+			uring_account(sl);
+			sl->iov.iov_base = (char*)sl->iov.iov_base + res;
+			sl->iov.iov_len -= res;
+			sl->pos += res;
+			if (sl->iov.iov_len != 0) {
+				/* Short write: write the rest */
+				if (!err)
+					uring_queue(&r, IORING_OP_WRITEV, ofd, sl, cqe->user_data, sl->pos);
+				continue;
+			}
+			res = sl->pos - (out_pos + sl->block * bs);
+			if ((size_t)res == bs)
+				G.out_full++;
+			else
+				G.out_part++;
+# if ENABLE_FEATURE_DD_THIRD_STATUS_LINE
+			G.total_bytes += res;
+# endif
+			if (written < sl->pos - out_pos)
+				written = sl->pos - out_pos;
+			if (!err && next_block < eof_block) {
+				sl->block = next_block++;
+				sl->iov.iov_base = sl->buf;
+				sl->iov.iov_len = bs;
+				sl->got = 0;
+				uring_queue(&r, IORING_OP_READV, ifd, sl, cqe->user_data & ~1,
+						in_pos + sl->block * bs);
+			}
+		}
+		__atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+	}
+	close(r.fd);
+
+	/* Partial last block with O_DIRECT: write it without O_DIRECT */
+	if (!err && (G.flags & FLAG_ODIRECT)) {
+		for (i = 0; i < depth; i++) {
+			if (slot[i].block == eof_block - 1 && slot[i].iov.iov_len != 0
+			 && slot[i].iov.iov_len != bs
+			) {
+				xlseek(ofd, slot[i].pos, SEEK_SET);
+				if (write_and_stats(slot[i].buf, slot[i].iov.iov_len, bs, outfile))
+					err = 2;
+				else
+					written = slot[i].pos + slot[i].iov.iov_len - out_pos;
+				break;
+			}
+		}
+	}
+	munmap(bufs, bs * depth);
+
+	/* Leave file positions as read/write loop would */
+	lseek(ifd, in_pos + read_end, SEEK_SET);
+	lseek(ofd, out_pos + written, SEEK_SET);
+	if (!err && (G.flags & FLAG_FSYNC) && fsync(ofd) < 0) {
+		bb_simple_perror_msg(outfile);
+		err = 2;
+	}
+	return err;
+}
+#endif
+
 #if ENABLE_LFS
 # define XATOU_SFX xatoull_sfx
 #else
@@ -243,14 +612,16 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 	static const char keywords[] ALIGN1 =
 		"bs\0""count\0""seek\0""skip\0""if\0""of\0"IF_FEATURE_DD_STATUS("status\0")
 #if ENABLE_FEATURE_DD_IBS_OBS
-		"ibs\0""obs\0""conv\0""iflag\0"
+		"ibs\0""obs\0""conv\0""iflag\0""oflag\0"
 #endif
 		;
 #if ENABLE_FEATURE_DD_IBS_OBS
 	static const char conv_words[] ALIGN1 =
-		"notrunc\0""sync\0""noerror\0""fsync\0""swab\0";
+		"notrunc\0""sync\0""noerror\0""fsync\0""swab\0""sparse\0";
 	static const char iflag_words[] ALIGN1 =
-		"skip_bytes\0";
+		"skip_bytes\0""direct\0";
+	static const char oflag_words[] ALIGN1 =
+		"direct\0" IF_FEATURE_DD_URING("uring\0");
 #endif
 #if ENABLE_FEATURE_DD_STATUS
 	static const char status_words[] ALIGN1 =
@@ -269,12 +640,14 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 		OP_obs,
 		OP_conv,
 		OP_iflag,
+		OP_oflag,
 		/* Must be in the same order as FLAG_XXX! */
 		OP_conv_notrunc = 0,
 		OP_conv_sync,
 		OP_conv_noerror,
 		OP_conv_fsync,
 		OP_conv_swab,
+		OP_conv_sparse,
 	/* Unimplemented conv=XXX: */
 	//nocreat       do not create the output file
 	//excl          fail if the output file already exists
@@ -289,6 +662,9 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 	/* Partially implemented: */
 	//swab          swap every pair of input bytes: will abort on non-even reads
 		OP_iflag_skip_bytes,
+		OP_iflag_direct,
+		OP_oflag_direct,
+		OP_oflag_uring,
 #endif
 	};
 	smallint exitcode = EXIT_FAILURE;
@@ -360,6 +736,10 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 			G.flags |= parse_comma_flags(val, iflag_words, "iflag") << FLAG_IFLAG_SHIFT;
 			/*continue;*/
 		}
+		if (what == OP_oflag) {
+			G.flags |= parse_comma_flags(val, oflag_words, "oflag") << FLAG_OFLAG_SHIFT;
+			/*continue;*/
+		}
 #endif
 		if (what == OP_bs) {
 			ibs = xatoul_range_sfx(val, 1, ((size_t)-1L)/2, cwbkMG_suffixes);
@@ -401,13 +781,29 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 	} /* end of "for (argv[i])" */
 
 //XXX:FIXME for huge ibs or obs, malloc'ing them isn't the brightest idea ever
-	ibuf = xmalloc(ibs);
-	obuf = ibuf;
 #if ENABLE_FEATURE_DD_IBS_OBS
-	if (ibs != obs) {
-		G.flags |= FLAG_TWOBUFS;
-		obuf = xmalloc(obs);
+	if (G.flags & (FLAG_IDIRECT | FLAG_ODIRECT)) {
+		/* O_DIRECT needs aligned buffers */
+		if (posix_memalign((void**)&ibuf, 4096, ibs) != 0
+		 || (ibs != obs && posix_memalign((void**)&obuf, 4096, obs) != 0)
+		) {
+			bb_error_msg_and_die(bb_msg_memory_exhausted);
+		}
+		if (ibs == obs)
+			obuf = ibuf;
+	} else
+#endif
+	{
+		ibuf = xmalloc(ibs);
+		obuf = ibuf;
+#if ENABLE_FEATURE_DD_IBS_OBS
+		if (ibs != obs)
+			obuf = xmalloc(obs);
+#endif
 	}
+#if ENABLE_FEATURE_DD_IBS_OBS
+	if (ibs != obs)
+		G.flags |= FLAG_TWOBUFS;
 #endif
 
 #if ENABLE_FEATURE_DD_SIGNAL_HANDLING
@@ -445,6 +841,12 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 	} else {
 		outfile = bb_msg_standard_output;
 	}
+#if ENABLE_FEATURE_DD_IBS_OBS
+	if (G.flags & FLAG_IDIRECT)
+		set_direct(ifd, 1, infile);
+	if (G.flags & FLAG_ODIRECT)
+		set_direct(ofd, 1, outfile);
+#endif
 	if (skip) {
 		size_t blocksz = (G.flags & FLAG_SKIP_BYTES) ? 1 : ibs;
 		if (lseek(ifd, skip * blocksz, SEEK_CUR) < 0) {
@@ -462,6 +864,18 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 			goto die_outfile;
 	}
 
+#if ENABLE_FEATURE_DD_URING
+	if (G.flags & FLAG_URING) {
+		i = dd_uring(ibs, count, infile, outfile);
+		if (i == 1)
+			xfunc_die(); /* read error, as below */
+		if (i == 2)
+			goto out_status;
+		if (i == 0)
+			goto copied;
+		/* else: can't use io_uring, do it the usual way */
+	}
+#endif
 	while (!(G.flags & FLAG_COUNT) || (G.in_full + G.in_part != count)) {
 		ssize_t n;
 
@@ -537,10 +951,22 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 		}
 	}
 
+#if ENABLE_FEATURE_DD_URING
+ copied:
+#endif
 	if (ENABLE_FEATURE_DD_IBS_OBS && oc) {
 		if (write_and_stats(obuf, oc, obs, outfile))
 			goto out_status;
 	}
+#if ENABLE_FEATURE_DD_IBS_OBS
+	if (G.out_hole) {
+		/* Output ends with a hole: only ftruncate can create it */
+		struct stat st;
+		off_t pos = xlseek(ofd, 0, SEEK_CUR);
+		if (fstat(ofd, &st) == 0 && st.st_size < pos && ftruncate(ofd, pos) < 0)
+			goto die_outfile;
+	}
+#endif
 	if (close(ifd) < 0) {
  die_infile:
 		bb_simple_perror_msg_and_die(infile);
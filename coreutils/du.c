@@ -24,7 +24,7 @@
  */
 
 //usage:#define du_trivial_usage
-//usage:       "[-aHLdclsx" IF_FEATURE_HUMAN_READABLE("hm") "k] [FILE]..."
+//usage:       "[-aHLdclsx" IF_FEATURE_HUMAN_READABLE("hm") "k]" IF_FEATURE_DU_PARALLEL(" [-j N]") " [FILE]..."
 //usage:#define du_full_usage "\n\n"
 //usage:       "Summarize disk space used for each FILE and/or directory\n"
 //usage:     "\n	-a	Show file sizes too"
@@ -35,6 +35,9 @@
 //usage:     "\n	-l	Count sizes many times if hard linked"
 //usage:     "\n	-s	Display only a total for each argument"
 //usage:     "\n	-x	Skip directories on different filesystems"
+//usage:	IF_FEATURE_DU_PARALLEL(
+//usage:     "\n	-j N	Scan subdirectories in N processes (0: one per CPU)"
+//usage:	)
 //usage:	IF_FEATURE_HUMAN_READABLE(
 //usage:     "\n	-h	Sizes in human readable format (e.g., 1K 243M 2G)"
 //usage:     "\n	-m	Sizes in megabytes"
@@ -85,10 +88,106 @@ struct globals {
 	int slink_depth;
 	int du_depth;
 	dev_t dir_dev;
+#if ENABLE_FEATURE_DU_PARALLEL
+	int nproc;
+	struct shared_ino_hash *shared_hash;
+	char **jobs;
+	unsigned long long *job_sum;
+#endif
 } FIX_ALIASING;
 #define G (*(struct globals*)bb_common_bufsiz1)
 #define INIT_G() do { setup_common_bufsiz(); } while (0)
 
+#if ENABLE_FEATURE_DU_PARALLEL
+#include <sched.h>
+#include <sys/mman.h>
+
+/* Hard links (and directories, for -L loops) seen by any of the workers.
+ * Lives in shared memory, so it can't grow: it is sized generously
+ * and mapped with MAP_NORESERVE, so only pages actually used cost memory.
+ * It is split into shards, each with its own spinlock, so that workers
+ * rarely wait for each other. Within a shard, open addressing
+ * with linear probing.
+ */
+#define INO_SHARDS      64
+#define INO_SHARD_SLOTS (sizeof(long) > 4 ? (1 << 18) : (1 << 13))
+
+struct ino_slot {
+	ino_t ino;
+	dev_t dev;
+	char isdir;
+	char used;
+};
+struct ino_shard {
+	int lock;
+	unsigned count;
+};
+struct shared_ino_hash {
+	struct ino_shard shard[INO_SHARDS];
+	struct ino_slot slot[INO_SHARDS][INO_SHARD_SLOTS];
+};
+
+static void shared_hash_open(void)
+{
+	G.shared_hash = mmap(NULL, sizeof(*G.shared_hash), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (G.shared_hash == MAP_FAILED)
+		bb_perror_msg_and_die("mmap");
+}
+
+static void shared_hash_close(void)
+{
+	munmap(G.shared_hash, sizeof(*G.shared_hash));
+	G.shared_hash = NULL;
+}
+
+/* Returns 1 if already seen, else remembers it and returns 0 */
+static int shared_hash_seen(const struct stat *st)
+{
+	struct ino_shard *shard;
+	struct ino_slot *slot;
+	unsigned long long h;
+	unsigned i, n;
+	char isdir = !!S_ISDIR(st->st_mode);
+	int found = 0;
+
+	h = ((unsigned long long)st->st_ino ^ ((unsigned long long)st->st_dev << 17))
+		* 0x9e3779b97f4a7c15ULL;
+	n = (unsigned)(h >> 58); /* top 6 bits: shard */
+	shard = &G.shared_hash->shard[n];
+	slot = G.shared_hash->slot[n];
+	i = (unsigned)h;
+
+	while (__sync_lock_test_and_set(&shard->lock, 1))
+		sched_yield();
+	for (;;) {
+		i %= INO_SHARD_SLOTS;
+		if (!slot[i].used) {
+			if (shard->count >= INO_SHARD_SLOTS / 4 * 3) {
+				__sync_lock_release(&shard->lock);
+				bb_error_msg_and_die("too many hard links, use -j1");
+			}
+			shard->count++;
+			slot[i].ino = st->st_ino;
+			slot[i].dev = st->st_dev;
+			slot[i].isdir = isdir;
+			slot[i].used = 1;
+			break;
+		}
+		if (slot[i].ino == st->st_ino
+		 && slot[i].dev == st->st_dev
+		 && slot[i].isdir == isdir
+		) {
+			found = 1;
+			break;
+		}
+		i++;
+	}
+	__sync_lock_release(&shard->lock);
+	return found;
+}
+#endif
+
 
 static void print(unsigned long long size, const char *filename)
 {
@@ -121,6 +220,71 @@ static void print(unsigned long long size, const char *filename)
 #endif
 }
 
+static unsigned long long du(const char *filename);
+
+#if ENABLE_FEATURE_DU_PARALLEL
+static int FAST_FUNC du_job(unsigned idx, void *arg UNUSED_PARAM)
+{
+	G.du_depth = 1;
+	G.job_sum[idx] = du(G.jobs[idx]);
+	G.du_depth = 0;
+	fflush_all();
+	return G.status;
+}
+
+/* Each subdirectory (and file) of a top-level directory is scanned
+ * by its own job. Workers report subtree sizes via shared memory,
+ * the parent adds them up. Output comes in the same order as without -j.
+ */
+static unsigned long long du_parallel(DIR *dir, const char *filename,
+		const struct stat *dirstat)
+{
+	struct dirent *entry;
+	unsigned long long sum;
+	unsigned njobs, i;
+	int *status;
+
+	njobs = 0;
+	while ((entry = readdir(dir))) {
+		char *newfile = concat_subpath_file(filename, entry->d_name);
+		if (newfile == NULL)
+			continue;
+		G.jobs = xrealloc_vector(G.jobs, 6, njobs);
+		G.jobs[njobs++] = newfile;
+	}
+	if (njobs == 0)
+		return 0;
+
+	G.job_sum = mmap(NULL, njobs * sizeof(G.job_sum[0]), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (G.job_sum == MAP_FAILED)
+		bb_perror_msg_and_die("mmap");
+	if (!(option_mask32 & OPT_l_hardlinks)) {
+		shared_hash_open();
+		/* a symlink to it (with -L) must not make us count it again */
+		shared_hash_seen(dirstat);
+	}
+	status = xmalloc(njobs * sizeof(status[0]));
+
+	run_parallel_ordered(njobs, G.nproc, du_job, NULL, status);
+
+	sum = 0;
+	for (i = 0; i < njobs; i++) {
+		sum += G.job_sum[i];
+		if (status[i])
+			G.status = EXIT_FAILURE;
+		free(G.jobs[i]);
+	}
+	free(status);
+	free(G.jobs);
+	G.jobs = NULL;
+	if (G.shared_hash)
+		shared_hash_close();
+	munmap(G.job_sum, njobs * sizeof(G.job_sum[0]));
+	return sum;
+}
+#endif
+
 /* tiny recursive du */
 static unsigned long long du(const char *filename)
 {
@@ -162,10 +326,18 @@ static unsigned long long du(const char *filename)
 	 && statbuf.st_nlink > 1
 	) {
 		/* Add files/directories with links only once */
-		if (is_in_ino_dev_hashtable(&statbuf)) {
-			return 0;
+#if ENABLE_FEATURE_DU_PARALLEL
+		if (G.shared_hash) {
+			if (shared_hash_seen(&statbuf))
+				return 0;
+		} else
+#endif
+		{
+			if (is_in_ino_dev_hashtable(&statbuf)) {
+				return 0;
+			}
+			add_to_ino_dev_hashtable(&statbuf, NULL);
 		}
-		add_to_ino_dev_hashtable(&statbuf, NULL);
 	}
 
 	if (S_ISDIR(statbuf.st_mode)) {
@@ -179,6 +351,11 @@ static unsigned long long du(const char *filename)
 			return sum;
 		}
 
+#if ENABLE_FEATURE_DU_PARALLEL
+		if (G.nproc > 1 && G.du_depth == 0) {
+			sum += du_parallel(dir, filename, &statbuf);
+		} else
+#endif
 		while ((entry = readdir(dir))) {
 			newfile = concat_subpath_file(filename, entry->d_name);
 			if (newfile == NULL)
@@ -218,6 +395,7 @@ int du_main(int argc UNUSED_PARAM, char **argv)
 	/* IF_NOT_FEATURE_DU_DEFAULT_BLOCKSIZE_1K(G.disp_k = 0;) - G is pre-zeroed */
 #endif
 	G.max_print_depth = INT_MAX;
+	IF_FEATURE_DU_PARALLEL(G.nproc = 1;)
 
 	/* Note: SUSv3 specifies that -a and -s options cannot be used together
 	 * in strictly conforming applications.  However, it also says that some
@@ -227,7 +405,8 @@ int du_main(int argc UNUSED_PARAM, char **argv)
 	 */
 #if ENABLE_FEATURE_HUMAN_READABLE
 	opt_complementary = "h-km:k-hm:m-hk:H-L:L-H:s-d:d-s";
-	opt = getopt32(argv, "aHkLsx" "d:+" "lc" "hm", &G.max_print_depth);
+	opt = getopt32(argv, "aHkLsx" "d:+" "lc" "hm" IF_FEATURE_DU_PARALLEL("j:+"),
+			&G.max_print_depth IF_FEATURE_DU_PARALLEL(, &G.nproc));
 	argv += optind;
 	if (opt & OPT_h_for_humans) {
 		G.disp_unit = 0;
@@ -240,7 +419,8 @@ int du_main(int argc UNUSED_PARAM, char **argv)
 	}
 #else
 	opt_complementary = "H-L:L-H:s-d:d-s";
-	opt = getopt32(argv, "aHkLsx" "d:+" "lc", &G.max_print_depth);
+	opt = getopt32(argv, "aHkLsx" "d:+" "lc" IF_FEATURE_DU_PARALLEL("j:+"),
+			&G.max_print_depth IF_FEATURE_DU_PARALLEL(, &G.nproc));
 	argv += optind;
 #if !ENABLE_FEATURE_DU_DEFAULT_BLOCKSIZE_1K
 	if (opt & OPT_k_kbytes) {
@@ -257,6 +437,10 @@ int du_main(int argc UNUSED_PARAM, char **argv)
 	if (opt & OPT_s_total_norecurse) {
 		G.max_print_depth = 0;
 	}
+#if ENABLE_FEATURE_DU_PARALLEL
+	if (G.nproc == 0)
+		G.nproc = get_cpu_count();
+#endif
 
 	/* go through remaining args (if any) */
 	if (!*argv) {
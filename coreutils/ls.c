@@ -99,6 +99,24 @@
 
 /* This is a NOEXEC applet. Be very careful! */
 
+/* libc has statx()? Then we ask kernel only for what we need */
+#if defined(STATX_TYPE) && defined(AT_STATX_SYNC_AS_STAT)
+# define USE_STATX 1
+#else
+# define USE_STATX 0
+/* Not asked from kernel, only to track what we need */
+# define STATX_TYPE   0x0001U
+# define STATX_MODE   0x0002U
+# define STATX_NLINK  0x0004U
+# define STATX_UID    0x0008U
+# define STATX_GID    0x0010U
+# define STATX_ATIME  0x0020U
+# define STATX_MTIME  0x0040U
+# define STATX_CTIME  0x0080U
+# define STATX_INO    0x0100U
+# define STATX_SIZE   0x0200U
+# define STATX_BLOCKS 0x0400U
+#endif
 
 #if ENABLE_FTPD
 /* ftpd uses ls, and without timestamps Mozilla won't understand
@@ -365,6 +383,8 @@ struct globals {
 	/* Do time() just once. Saves one syscall per file for "ls -l" */
 	time_t current_time_t;
 #endif
+	/* STATX_xxx bits of what we need to know about files */
+	unsigned stat_mask;
 } FIX_ALIASING;
 #define G (*(struct globals*)bb_common_bufsiz1)
 #define INIT_G() do { \
@@ -713,16 +733,81 @@ static void display_files(struct dnode **dn, unsigned nfiles)
 
 /*** Dir scanning code ***/
 
-static struct dnode *my_stat(const char *fullname, const char *name, int force_follow)
+/* d_type is DT_xxx from readdir, or DT_UNKNOWN */
+static struct dnode *my_stat(const char *fullname, const char *name, int force_follow,
+		unsigned d_type)
 {
 	struct stat statbuf;
 	struct dnode *cur;
+	int follow;
 
 	cur = xzalloc(sizeof(*cur));
 	cur->fullname = fullname;
 	cur->name = name;
+	follow = (option_mask32 & OPT_L) || force_follow;
+
+	/* Can we do without stat? We don't know target's type of a symlink.
+	 * If only -F or color need mode, they need it only for regular files
+	 * (to show executables) */
+	if (d_type != DT_UNKNOWN
+	 && !(follow && d_type == DT_LNK)
+	 && (G.stat_mask == STATX_TYPE
+	    || (G.stat_mask == (STATX_TYPE|STATX_MODE) && d_type != DT_REG && d_type != DT_LNK)
+	    )
+#if ENABLE_SELINUX
+	 && !is_selinux_enabled()
+#endif
+	) {
+		cur->dn_mode = DTTOIF(d_type);
+		/* (if it's not a symlink, stat and lstat say the same) */
+		if (follow || d_type != DT_LNK)
+			cur->dn_mode_stat = cur->dn_mode;
+		if (!follow || d_type != DT_LNK)
+			cur->dn_mode_lstat = cur->dn_mode;
+		return cur;
+	}
+
+#if USE_STATX
+# if ENABLE_SELINUX
+	if (!is_selinux_enabled()) /* then we need *getfilecon() too, see below */
+# endif
+	{
+		struct statx sx;
+
+		if (statx(AT_FDCWD, fullname, follow ? 0 : AT_SYMLINK_NOFOLLOW,
+				G.stat_mask, &sx) == 0
+		) {
+			if (follow)
+				cur->dn_mode_stat = sx.stx_mode;
+			else
+				cur->dn_mode_lstat = sx.stx_mode;
+			cur->dn_mode   = sx.stx_mode  ;
+			cur->dn_size   = sx.stx_size  ;
+# if ENABLE_FEATURE_LS_TIMESTAMPS || ENABLE_FEATURE_LS_SORTFILES
+			cur->dn_atime  = sx.stx_atime.tv_sec;
+			cur->dn_mtime  = sx.stx_mtime.tv_sec;
+			cur->dn_ctime  = sx.stx_ctime.tv_sec;
+# endif
+			cur->dn_ino    = sx.stx_ino   ;
+			cur->dn_blocks = sx.stx_blocks;
+			cur->dn_nlink  = sx.stx_nlink ;
+			cur->dn_uid    = sx.stx_uid   ;
+			cur->dn_gid    = sx.stx_gid   ;
+			cur->dn_rdev_maj = sx.stx_rdev_major;
+			cur->dn_rdev_min = sx.stx_rdev_minor;
+			return cur;
+		}
+		if (errno != ENOSYS) {
+			bb_simple_perror_msg(fullname);
+			G.exit_code = EXIT_FAILURE;
+			free(cur);
+			return NULL;
+		}
+		/* old kernel, use stat */
+	}
+#endif
 
-	if ((option_mask32 & OPT_L) || force_follow) {
+	if (follow) {
 #if ENABLE_SELINUX
 		if (is_selinux_enabled())  {
 			getfilecon(fullname, &cur->sid);
@@ -964,7 +1049,13 @@ static struct dnode **scan_one_dir(const char *path, unsigned *nfiles_p)
 				continue;
 		}
 		fullname = concat_path_file(path, entry->d_name);
-		cur = my_stat(fullname, bb_basename(fullname), 0);
+		cur = my_stat(fullname, bb_basename(fullname), 0,
+# ifdef _DIRENT_HAVE_D_TYPE
+				entry->d_type
+# else
+				DT_UNKNOWN
+# endif
+		);
 		if (!cur) {
 			free(fullname);
 			continue;
@@ -1189,6 +1280,38 @@ int ls_main(int argc UNUSED_PARAM, char **argv)
 	if (!(G.all_fmt & STYLE_MASK))
 		G.all_fmt |= (isatty(STDOUT_FILENO) ? STYLE_COLUMNAR : STYLE_SINGLE);
 
+	/* What do we need to know about files? (plain "ls" needs nothing
+	 * which readdir doesn't tell, "ls -l" needs almost everything) */
+	G.stat_mask = STATX_TYPE;
+	if (G.all_fmt & LIST_INO)
+		G.stat_mask |= STATX_INO;
+	if ((G.all_fmt & LIST_BLOCKS) || (G.all_fmt & STYLE_MASK) == STYLE_LONG)
+		G.stat_mask |= STATX_BLOCKS;
+	if (G.all_fmt & LIST_MODEBITS)
+		G.stat_mask |= STATX_MODE;
+	if (G.all_fmt & LIST_NLINKS)
+		G.stat_mask |= STATX_NLINK;
+	if (G.all_fmt & (LIST_ID_NAME|LIST_ID_NUMERIC))
+		G.stat_mask |= STATX_UID | STATX_GID;
+	if (G.all_fmt & LIST_SIZE)
+		G.stat_mask |= STATX_SIZE;
+	if ((G.all_fmt & (LIST_DATE_TIME|LIST_FULLTIME))
+	 || (G.all_fmt & SORT_MASK) == SORT_MTIME
+	) {
+		G.stat_mask |= (G.all_fmt & TIME_ACCESS) ? STATX_ATIME
+			: (G.all_fmt & TIME_CHANGE) ? STATX_CTIME
+			: STATX_MTIME;
+	}
+	if ((G.all_fmt & SORT_MASK) == SORT_ATIME)
+		G.stat_mask |= STATX_ATIME;
+	if ((G.all_fmt & SORT_MASK) == SORT_CTIME)
+		G.stat_mask |= STATX_CTIME;
+	if ((G.all_fmt & SORT_MASK) == SORT_SIZE)
+		G.stat_mask |= STATX_SIZE;
+	/* executables are shown differently */
+	if ((G.all_fmt & LIST_CLASSIFY) || G_show_color)
+		G.stat_mask |= STATX_MODE;
+
 	argv += optind;
 	if (!argv[0])
 		*--argv = (char*)".";
@@ -1209,6 +1332,7 @@ int ls_main(int argc UNUSED_PARAM, char **argv)
 			/* ... or if -H: */
 			|| (option_mask32 & OPT_H)
 			/* ... or if -L, but my_stat always follows links if -L */
+			, DT_UNKNOWN
 		);
 		argv++;
 		if (!cur)
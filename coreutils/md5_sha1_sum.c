@@ -47,6 +47,15 @@
 //config:	  against pre-calculated hash values.
 //config:
 //config:	  -s and -w are useful options when verifying checksums.
+//config:
+//config:config FEATURE_MD5_SHA1_SUM_PARALLEL
+//config:	bool "Enable -j N option to hash files in parallel"
+//config:	default y
+//config:	depends on (MD5SUM || SHA1SUM || SHA256SUM || SHA512SUM || SHA3SUM) && !NOMMU
+//config:	help
+//config:	  Hash several files at once in worker processes. Output is
+//config:	  the same as without -j. Useful when checking long lists
+//config:	  of files with -c.
 
 //applet:IF_MD5SUM(APPLET_NOEXEC(md5sum, md5_sha1_sum, BB_DIR_USR_BIN, BB_SUID_DROP, md5sum))
 //applet:IF_SHA1SUM(APPLET_NOEXEC(sha1sum, md5_sha1_sum, BB_DIR_USR_BIN, BB_SUID_DROP, sha1sum))
@@ -61,7 +70,7 @@
 //kbuild:lib-$(CONFIG_SHA3SUM)   += md5_sha1_sum.o
 
 //usage:#define md5sum_trivial_usage
-//usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK("[-c[sw]] ")"[FILE]..."
+//usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK("[-c[sw]] ")IF_FEATURE_MD5_SHA1_SUM_PARALLEL("[-j N] ")"[FILE]..."
 //usage:#define md5sum_full_usage "\n\n"
 //usage:       "Print" IF_FEATURE_MD5_SHA1_SUM_CHECK(" or check") " MD5 checksums"
 //usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK( "\n"
@@ -69,6 +78,9 @@
 //usage:     "\n	-s	Don't output anything, status code shows success"
 //usage:     "\n	-w	Warn about improperly formatted checksum lines"
 //usage:	)
+//usage:	IF_FEATURE_MD5_SHA1_SUM_PARALLEL(
+//usage:     "\n	-j N	Hash N files at once (0: one per CPU)"
+//usage:	)
 //usage:
 //usage:#define md5sum_example_usage
 //usage:       "$ md5sum < busybox\n"
@@ -81,7 +93,7 @@
 //usage:       "^D\n"
 //usage:
 //usage:#define sha1sum_trivial_usage
-//usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK("[-c[sw]] ")"[FILE]..."
+//usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK("[-c[sw]] ")IF_FEATURE_MD5_SHA1_SUM_PARALLEL("[-j N] ")"[FILE]..."
 //usage:#define sha1sum_full_usage "\n\n"
 //usage:       "Print" IF_FEATURE_MD5_SHA1_SUM_CHECK(" or check") " SHA1 checksums"
 //usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK( "\n"
@@ -89,9 +101,12 @@
 //usage:     "\n	-s	Don't output anything, status code shows success"
 //usage:     "\n	-w	Warn about improperly formatted checksum lines"
 //usage:	)
+//usage:	IF_FEATURE_MD5_SHA1_SUM_PARALLEL(
+//usage:     "\n	-j N	Hash N files at once (0: one per CPU)"
+//usage:	)
 //usage:
 //usage:#define sha256sum_trivial_usage
-//usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK("[-c[sw]] ")"[FILE]..."
+//usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK("[-c[sw]] ")IF_FEATURE_MD5_SHA1_SUM_PARALLEL("[-j N] ")"[FILE]..."
 //usage:#define sha256sum_full_usage "\n\n"
 //usage:       "Print" IF_FEATURE_MD5_SHA1_SUM_CHECK(" or check") " SHA256 checksums"
 //usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK( "\n"
@@ -99,9 +114,12 @@
 //usage:     "\n	-s	Don't output anything, status code shows success"
 //usage:     "\n	-w	Warn about improperly formatted checksum lines"
 //usage:	)
+//usage:	IF_FEATURE_MD5_SHA1_SUM_PARALLEL(
+//usage:     "\n	-j N	Hash N files at once (0: one per CPU)"
+//usage:	)
 //usage:
 //usage:#define sha512sum_trivial_usage
-//usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK("[-c[sw]] ")"[FILE]..."
+//usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK("[-c[sw]] ")IF_FEATURE_MD5_SHA1_SUM_PARALLEL("[-j N] ")"[FILE]..."
 //usage:#define sha512sum_full_usage "\n\n"
 //usage:       "Print" IF_FEATURE_MD5_SHA1_SUM_CHECK(" or check") " SHA512 checksums"
 //usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK( "\n"
@@ -109,9 +127,12 @@
 //usage:     "\n	-s	Don't output anything, status code shows success"
 //usage:     "\n	-w	Warn about improperly formatted checksum lines"
 //usage:	)
+//usage:	IF_FEATURE_MD5_SHA1_SUM_PARALLEL(
+//usage:     "\n	-j N	Hash N files at once (0: one per CPU)"
+//usage:	)
 //usage:
 //usage:#define sha3sum_trivial_usage
-//usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK("[-c[sw]] ")"[-a BITS] [FILE]..."
+//usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK("[-c[sw]] ")IF_FEATURE_MD5_SHA1_SUM_PARALLEL("[-j N] ")"[-a BITS] [FILE]..."
 //usage:#define sha3sum_full_usage "\n\n"
 //usage:       "Print" IF_FEATURE_MD5_SHA1_SUM_CHECK(" or check") " SHA3 checksums"
 //usage:	IF_FEATURE_MD5_SHA1_SUM_CHECK( "\n"
@@ -120,6 +141,9 @@
 //usage:     "\n	-w	Warn about improperly formatted checksum lines"
 //usage:     "\n	-a BITS	224 (default), 256, 384, 512"
 //usage:	)
+//usage:	IF_FEATURE_MD5_SHA1_SUM_PARALLEL(
+//usage:     "\n	-j N	Hash N files at once (0: one per CPU)"
+//usage:	)
 
 //FIXME: GNU coreutils 8.25 has no -s option, it has only these two long opts:
 // --quiet   don't print OK for each successfully verified file
@@ -229,6 +253,10 @@ static uint8_t *hash_file(const char *filename, unsigned sha3_width)
 
 	{
 		RESERVE_CONFIG_UBUFFER(in_buf, 4096);
+		struct stat st;
+
+		if (fstat(src_fd, &st) == 0 && S_ISREG(st.st_mode))
+			posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 		while ((count = safe_read(src_fd, in_buf, 4096)) > 0) {
 			update(&context, in_buf, count);
 		}
@@ -249,13 +277,77 @@ static uint8_t *hash_file(const char *filename, unsigned sha3_width)
 	return hash_value;
 }
 
+/* Returns 0 if file matches its hash in line, 1 otherwise */
+static int check_line(char *line, unsigned flags, unsigned sha3_width)
+{
+	uint8_t *hash_value;
+	char *filename_ptr;
+	int failed = 1;
+
+	filename_ptr = strstr(line, "  ");
+	/* handle format for binary checksums */
+	if (filename_ptr == NULL) {
+		filename_ptr = strstr(line, " *");
+	}
+	if (filename_ptr == NULL) {
+		if (flags & FLAG_WARN) {
+			bb_error_msg("invalid format");
+		}
+		return failed;
+	}
+	*filename_ptr = '\0';
+	filename_ptr += 2;
+
+	hash_value = hash_file(filename_ptr, sha3_width);
+
+	if (hash_value && (strcmp((char*)hash_value, line) == 0)) {
+		if (!(flags & FLAG_SILENT))
+			printf("%s: OK\n", filename_ptr);
+		failed = 0;
+	} else {
+		if (!(flags & FLAG_SILENT))
+			printf("%s: FAILED\n", filename_ptr);
+	}
+	/* possible free(NULL) */
+	free(hash_value);
+	return failed;
+}
+
+static int print_hash(const char *filename, unsigned sha3_width)
+{
+	uint8_t *hash_value = hash_file(filename, sha3_width);
+	if (hash_value == NULL)
+		return EXIT_FAILURE;
+	printf("%s  %s\n", hash_value, filename);
+	free(hash_value);
+	return EXIT_SUCCESS;
+}
+
+#if ENABLE_FEATURE_MD5_SHA1_SUM_PARALLEL
+struct job_args {
+	char **list;
+	unsigned flags;
+	unsigned sha3_width;
+};
+
+static int FAST_FUNC hash_job(unsigned idx, void *arg)
+{
+	struct job_args *a = arg;
+	if (a->flags & FLAG_CHECK)
+		return check_line(a->list[idx], a->flags, a->sha3_width);
+	return print_hash(a->list[idx], a->sha3_width);
+}
+#endif
+
 int md5_sha1_sum_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int md5_sha1_sum_main(int argc UNUSED_PARAM, char **argv)
 {
 	int return_value = EXIT_SUCCESS;
 	unsigned flags;
-#if ENABLE_SHA3SUM
 	unsigned sha3_width = 224;
+#if ENABLE_FEATURE_MD5_SHA1_SUM_PARALLEL
+	unsigned nproc = 1;
+	struct job_args args;
 #endif
 
 	if (ENABLE_FEATURE_MD5_SHA1_SUM_CHECK) {
@@ -264,23 +356,55 @@ int md5_sha1_sum_main(int argc UNUSED_PARAM, char **argv)
 		/* -b "binary", -t "text" are ignored (shaNNNsum compat) */
 #if ENABLE_SHA3SUM
 		if (applet_name[3] == HASH_SHA3)
-			flags = getopt32(argv, "scwbta:+", &sha3_width);
+			flags = getopt32(argv, "scwbta:+" IF_FEATURE_MD5_SHA1_SUM_PARALLEL("j:+"),
+					&sha3_width IF_FEATURE_MD5_SHA1_SUM_PARALLEL(, &nproc));
 		else
 #endif
-			flags = getopt32(argv, "scwbt");
+			flags = getopt32(argv, "scwbt" IF_FEATURE_MD5_SHA1_SUM_PARALLEL("j:+")
+					IF_FEATURE_MD5_SHA1_SUM_PARALLEL(, &nproc));
 	} else {
+		flags = 0;
 #if ENABLE_SHA3SUM
 		if (applet_name[3] == HASH_SHA3)
-			getopt32(argv, "a:+", &sha3_width);
+			getopt32(argv, "a:+" IF_FEATURE_MD5_SHA1_SUM_PARALLEL("j:+"),
+					&sha3_width IF_FEATURE_MD5_SHA1_SUM_PARALLEL(, &nproc));
 		else
 #endif
-			getopt32(argv, "");
+			getopt32(argv, "" IF_FEATURE_MD5_SHA1_SUM_PARALLEL("j:+")
+					IF_FEATURE_MD5_SHA1_SUM_PARALLEL(, &nproc));
 	}
 	argv += optind;
 	//argc -= optind;
 	if (!*argv)
 		*--argv = (char*)"-";
 
+#if ENABLE_FEATURE_MD5_SHA1_SUM_PARALLEL
+	if (nproc == 0)
+		nproc = get_cpu_count();
+	args.flags = flags;
+	args.sha3_width = sha3_width;
+	if (nproc > 1 && !(flags & FLAG_CHECK)) {
+		int *status;
+		unsigned i, n;
+
+		n = 0;
+		while (argv[n]) {
+			/* Only one reader of stdin at a time, please */
+			if (LONE_DASH(argv[n]))
+				goto serial;
+			n++;
+		}
+		status = xmalloc(n * sizeof(status[0]));
+		args.list = argv;
+		run_parallel_ordered(n, nproc, hash_job, &args, status);
+		for (i = 0; i < n; i++)
+			return_value |= status[i];
+		free(status);
+		return return_value;
+	}
+ serial:
+#endif
+
 	do {
 		if (ENABLE_FEATURE_MD5_SHA1_SUM_CHECK && (flags & FLAG_CHECK)) {
 			FILE *pre_computed_stream;
@@ -290,46 +414,38 @@ int md5_sha1_sum_main(int argc UNUSED_PARAM, char **argv)
 
 			pre_computed_stream = xfopen_stdin(*argv);
 
-			while ((line = xmalloc_fgetline(pre_computed_stream)) != NULL) {
-				uint8_t *hash_value;
-				char *filename_ptr;
+#if ENABLE_FEATURE_MD5_SHA1_SUM_PARALLEL
+			if (nproc > 1) {
+				/* Read the whole list, then check it in parallel */
+				int *status;
+				int i;
 
-				count_total++;
-				filename_ptr = strstr(line, "  ");
-				/* handle format for binary checksums */
-				if (filename_ptr == NULL) {
-					filename_ptr = strstr(line, " *");
+				args.list = NULL;
+				while ((line = xmalloc_fgetline(pre_computed_stream)) != NULL) {
+					args.list = xrealloc_vector(args.list, 6, count_total);
+					args.list[count_total++] = line;
 				}
-				if (filename_ptr == NULL) {
-					if (flags & FLAG_WARN) {
-						bb_error_msg("invalid format");
-					}
-					count_failed++;
-					return_value = EXIT_FAILURE;
-					free(line);
-					continue;
+				status = xmalloc(count_total * sizeof(status[0]));
+				run_parallel_ordered(count_total, nproc, hash_job, &args, status);
+				for (i = 0; i < count_total; i++) {
+					count_failed += status[i];
+					free(args.list[i]);
 				}
-				*filename_ptr = '\0';
-				filename_ptr += 2;
-
-				hash_value = hash_file(filename_ptr, sha3_width);
-
-				if (hash_value && (strcmp((char*)hash_value, line) == 0)) {
-					if (!(flags & FLAG_SILENT))
-						printf("%s: OK\n", filename_ptr);
-				} else {
-					if (!(flags & FLAG_SILENT))
-						printf("%s: FAILED\n", filename_ptr);
-					count_failed++;
-					return_value = EXIT_FAILURE;
-				}
-				/* possible free(NULL) */
-				free(hash_value);
+				free(args.list);
+				free(status);
+			} else
+#endif
+			while ((line = xmalloc_fgetline(pre_computed_stream)) != NULL) {
+				count_total++;
+				count_failed += check_line(line, flags, sha3_width);
 				free(line);
 			}
-			if (count_failed && !(flags & FLAG_SILENT)) {
-				bb_error_msg("WARNING: %d of %d computed checksums did NOT match",
-						count_failed, count_total);
+			if (count_failed) {
+				return_value = EXIT_FAILURE;
+				if (!(flags & FLAG_SILENT)) {
+					bb_error_msg("WARNING: %d of %d computed checksums did NOT match",
+							count_failed, count_total);
+				}
 			}
 			if (count_total == 0) {
 				return_value = EXIT_FAILURE;
@@ -341,13 +457,7 @@ int md5_sha1_sum_main(int argc UNUSED_PARAM, char **argv)
 			}
 			fclose_if_not_stdin(pre_computed_stream);
 		} else {
-			uint8_t *hash_value = hash_file(*argv, sha3_width);
-			if (hash_value == NULL) {
-				return_value = EXIT_FAILURE;
-			} else {
-				printf("%s  %s\n", hash_value, *argv);
-				free(hash_value);
-			}
+			return_value |= print_hash(*argv, sha3_width);
 		}
 	} while (*++argv);
 
@@ -15,6 +15,8 @@
 //usage:#define sort_trivial_usage
 //usage:       "[-nru"
 //usage:	IF_FEATURE_SORT_BIG("gMcszbdfiokt] [-o FILE] [-k start[.offset][opts][,end[.offset][opts]] [-t CHAR")
+//usage:	IF_FEATURE_SORT_EXTERNAL("] [-m] [-S SIZE] [-T DIR")
+//usage:	IF_FEATURE_SORT_PARALLEL("] [--parallel=N")
 //usage:       "] [FILE]..."
 //usage:#define sort_full_usage "\n\n"
 //usage:       "Sort lines of text\n"
@@ -41,9 +43,14 @@
 //usage:     "\n	-u	Suppress duplicate lines"
 //usage:	IF_FEATURE_SORT_BIG(
 //usage:     "\n	-z	Lines are terminated by NUL, not newline"
-////usage:     "\n	-m	Ignored for GNU compatibility"
-////usage:     "\n	-S BUFSZ Ignored for GNU compatibility"
-////usage:     "\n	-T TMPDIR Ignored for GNU compatibility"
+//usage:	)
+//usage:	IF_FEATURE_SORT_EXTERNAL(
+//usage:     "\n	-m	Merge already sorted files"
+//usage:     "\n	-S SIZE	Sort in chunks of SIZE kbytes (suffixes: b,k,M,G,%)"
+//usage:     "\n	-T DIR	Directory for temporary files"
+//usage:	)
+//usage:	IF_FEATURE_SORT_PARALLEL(
+//usage:     "\n	--parallel=N	Sort using N processes (0: one per CPU)"
 //usage:	)
 //usage:
 //usage:#define sort_example_usage
@@ -63,6 +70,9 @@
 //usage:       ""
 
 #include "libbb.h"
+#if ENABLE_FEATURE_SORT_PARALLEL
+# include <sys/mman.h>
+#endif
 
 /* This is a NOEXEC applet. Be very careful! */
 
@@ -89,12 +99,13 @@ enum {
 	FLAG_d  = 0x200,        /* Ignore !(isalnum()|isspace()) */
 	FLAG_f  = 0x400,        /* Force uppercase */
 	FLAG_i  = 0x800,        /* Ignore !isprint() */
-	FLAG_m  = 0x1000,       /* ignored: merge already sorted files; do not sort */
-	FLAG_S  = 0x2000,       /* ignored: -S, --buffer-size=SIZE */
-	FLAG_T  = 0x4000,       /* ignored: -T, --temporary-directory=DIR */
+	FLAG_m  = 0x1000,       /* Merge already sorted files; do not sort */
+	FLAG_S  = 0x2000,       /* -S, --buffer-size=SIZE */
+	FLAG_T  = 0x4000,       /* -T, --temporary-directory=DIR */
 	FLAG_o  = 0x8000,
 	FLAG_k  = 0x10000,
 	FLAG_t  = 0x20000,
+	FLAG_parallel = 0x40000, /* --parallel=N */
 	FLAG_bb = 0x80000000,   /* Ignore trailing blanks  */
 };
 
@@ -221,108 +232,91 @@ static struct sort_key *add_key(void)
 #define GET_LINE(fp) xmalloc_fgetline(fp)
 #endif
 
-/* Iterate through keys list and perform comparisons */
-static int compare_keys(const void *xarg, const void *yarg)
+/* Compare one key of two lines */
+static int compare_key(char *x, char *y, int flags)
 {
-	int flags = option_mask32, retval = 0;
-	char *x, *y;
-
-#if ENABLE_FEATURE_SORT_BIG
-	struct sort_key *key;
+	int retval = 0;
 
-	for (key = key_list; !retval && key; key = key->next_key) {
-		flags = key->flags ? key->flags : option_mask32;
-		/* Chop out and modify key chunks, handling -dfib */
-		x = get_key(*(char **)xarg, key, flags);
-		y = get_key(*(char **)yarg, key, flags);
-#else
-	/* This curly bracket serves no purpose but to match the nesting
-	 * level of the for () loop we're not using */
-	{
-		x = *(char **)xarg;
-		y = *(char **)yarg;
-#endif
-		/* Perform actual comparison */
-		switch (flags & (FLAG_n | FLAG_M | FLAG_g)) {
-		default:
-			bb_error_msg_and_die("unknown sort type");
-			break;
-		/* Ascii sort */
-		case 0:
+	switch (flags & (FLAG_n | FLAG_M | FLAG_g)) {
+	default:
+		bb_error_msg_and_die("unknown sort type");
+		break;
+	/* Ascii sort */
+	case 0:
 #if ENABLE_LOCALE_SUPPORT
-			retval = strcoll(x, y);
+		retval = strcoll(x, y);
 #else
-			retval = strcmp(x, y);
+		retval = strcmp(x, y);
 #endif
-			break;
+		break;
 #if ENABLE_FEATURE_SORT_BIG
-		case FLAG_g: {
-			char *xx, *yy;
-			double dx = strtod(x, &xx);
-			double dy = strtod(y, &yy);
-			/* not numbers < NaN < -infinity < numbers < +infinity) */
-			if (x == xx)
-				retval = (y == yy ? 0 : -1);
-			else if (y == yy)
-				retval = 1;
-			/* Check for isnan */
-			else if (dx != dx)
-				retval = (dy != dy) ? 0 : -1;
-			else if (dy != dy)
-				retval = 1;
-			/* Check for infinity.  Could underflow, but it avoids libm. */
-			else if (1.0 / dx == 0.0) {
-				if (dx < 0)
-					retval = (1.0 / dy == 0.0 && dy < 0) ? 0 : -1;
-				else
-					retval = (1.0 / dy == 0.0 && dy > 0) ? 0 : 1;
-			} else if (1.0 / dy == 0.0)
-				retval = (dy < 0) ? 1 : -1;
+	case FLAG_g: {
+		char *xx, *yy;
+		double dx = strtod(x, &xx);
+		double dy = strtod(y, &yy);
+		/* not numbers < NaN < -infinity < numbers < +infinity) */
+		if (x == xx)
+			retval = (y == yy ? 0 : -1);
+		else if (y == yy)
+			retval = 1;
+		/* Check for isnan */
+		else if (dx != dx)
+			retval = (dy != dy) ? 0 : -1;
+		else if (dy != dy)
+			retval = 1;
+		/* Check for infinity.  Could underflow, but it avoids libm. */
+		else if (1.0 / dx == 0.0) {
+			if (dx < 0)
+				retval = (1.0 / dy == 0.0 && dy < 0) ? 0 : -1;
 			else
-				retval = (dx > dy) ? 1 : ((dx < dy) ? -1 : 0);
-			break;
-		}
-		case FLAG_M: {
-			struct tm thyme;
-			int dx;
-			char *xx, *yy;
-
-			xx = strptime(x, "%b", &thyme);
-			dx = thyme.tm_mon;
-			yy = strptime(y, "%b", &thyme);
-			if (!xx)
-				retval = (!yy) ? 0 : -1;
-			else if (!yy)
-				retval = 1;
-			else
-				retval = dx - thyme.tm_mon;
-			break;
-		}
-		/* Full floating point version of -n */
-		case FLAG_n: {
-			double dx = atof(x);
-			double dy = atof(y);
+				retval = (1.0 / dy == 0.0 && dy > 0) ? 0 : 1;
+		} else if (1.0 / dy == 0.0)
+			retval = (dy < 0) ? 1 : -1;
+		else
 			retval = (dx > dy) ? 1 : ((dx < dy) ? -1 : 0);
-			break;
-		}
-		} /* switch */
-		/* Free key copies. */
-		if (x != *(char **)xarg) free(x);
-		if (y != *(char **)yarg) free(y);
-		/* if (retval) break; - done by for () anyway */
+		break;
+	}
+	case FLAG_M: {
+		struct tm thyme;
+		int dx;
+		char *xx, *yy;
+
+		xx = strptime(x, "%b", &thyme);
+		dx = thyme.tm_mon;
+		yy = strptime(y, "%b", &thyme);
+		if (!xx)
+			retval = (!yy) ? 0 : -1;
+		else if (!yy)
+			retval = 1;
+		else
+			retval = dx - thyme.tm_mon;
+		break;
+	}
+	/* Full floating point version of -n */
+	case FLAG_n: {
+		double dx = atof(x);
+		double dy = atof(y);
+		retval = (dx > dy) ? 1 : ((dx < dy) ? -1 : 0);
+		break;
+	}
 #else
-		/* Integer version of -n for tiny systems */
-		case FLAG_n:
-			retval = atoi(x) - atoi(y);
-			break;
-		} /* switch */
+	/* Integer version of -n for tiny systems */
+	case FLAG_n:
+		retval = atoi(x) - atoi(y);
+		break;
 #endif
-	} /* for */
+	} /* switch */
 
-	/* Perform fallback sort if necessary */
+	return retval;
+}
+
+/* Perform fallback sort if necessary, handle -r.
+ * flags are those of the key which decided the comparison */
+static int finish_compare(int retval, int flags, const char *x, const char *y)
+{
 	if (!retval && !(option_mask32 & FLAG_s)) {
 		flags = option_mask32;
-		retval = strcmp(*(char **)xarg, *(char **)yarg);
+		retval = strcmp(x, y);
 	}
 
 	if (flags & FLAG_r)
@@ -331,6 +325,33 @@ static int compare_keys(const void *xarg, const void *yarg)
 	return retval;
 }
 
+/* Iterate through keys list and perform comparisons */
+static int compare_keys(const void *xarg, const void *yarg)
+{
+	int flags = option_mask32, retval = 0;
+#if ENABLE_FEATURE_SORT_BIG
+	struct sort_key *key;
+
+	for (key = key_list; !retval && key; key = key->next_key) {
+		char *x, *y;
+
+		flags = key->flags ? key->flags : option_mask32;
+		/* Chop out and modify key chunks, handling -dfib */
+		x = get_key(*(char **)xarg, key, flags);
+		y = get_key(*(char **)yarg, key, flags);
+		retval = compare_key(x, y, flags);
+		/* Free key copies. */
+		if (x != *(char **)xarg) free(x);
+		if (y != *(char **)yarg) free(y);
+		/* if (retval) break; - done by for () anyway */
+	}
+#else
+	retval = compare_key(*(char **)xarg, *(char **)yarg, flags);
+#endif
+
+	return finish_compare(retval, flags, *(char **)xarg, *(char **)yarg);
+}
+
 #if ENABLE_FEATURE_SORT_BIG
 static unsigned str2u(char **str)
 {
@@ -344,22 +365,526 @@ static unsigned str2u(char **str)
 }
 #endif
 
+#if ENABLE_FEATURE_SORT_BIG
+/* Keys of every line are extracted (and -n keys converted to numbers)
+ * once before sorting, not twice per comparison. Leading bytes
+ * of the first key are stored in the record itself, most comparisons
+ * are decided by them without touching the line.
+ */
+struct key_val {
+	char *str;         /* NULL for -n keys */
+	double num;        /* -n keys */
+};
+
+struct sort_rec {
+	uint64_t prefix;   /* first key's first 8 bytes, big-endian, or 0 */
+	char *line;
+	struct key_val *kv;
+};
+
+static unsigned key_count;
+static smallint use_prefix;
+
+static void make_rec(struct sort_rec *rec, char *line, struct key_val *kv)
+{
+	struct sort_key *key;
+
+	rec->line = line;
+	rec->kv = kv;
+	for (key = key_list; key; key = key->next_key, kv++) {
+		int flags = key->flags ? key->flags : option_mask32;
+
+		kv->str = get_key(line, key, flags);
+		if ((flags & (FLAG_n | FLAG_M | FLAG_g)) == FLAG_n) {
+			kv->num = atof(kv->str);
+			if (kv->str != line)
+				free(kv->str);
+			kv->str = NULL;
+		}
+	}
+
+	rec->prefix = 0;
+	if (use_prefix) {
+		const char *p = rec->kv[0].str;
+		int i;
+		/* Pad with zeros: compares the same as strcmp would */
+		for (i = 0; i < 8; i++) {
+			rec->prefix <<= 8;
+			if (*p)
+				rec->prefix |= (unsigned char)*p++;
+		}
+	}
+}
+
+static void free_rec_keys(struct sort_rec *rec)
+{
+	unsigned i;
+
+	for (i = 0; i < key_count; i++) {
+		if (rec->kv[i].str != rec->line)
+			free(rec->kv[i].str);
+	}
+}
+
+/* Same as compare_keys(), but on struct sort_rec */
+static int compare_recs(const void *xarg, const void *yarg)
+{
+	const struct sort_rec *x = xarg;
+	const struct sort_rec *y = yarg;
+	struct sort_key *key = key_list;
+	int flags, retval;
+	unsigned i;
+
+	flags = key->flags ? key->flags : option_mask32;
+	if (x->prefix != y->prefix)
+		return finish_compare((x->prefix < y->prefix) ? -1 : 1, flags, NULL, NULL);
+
+	retval = 0;
+	for (i = 0; !retval && key; key = key->next_key, i++) {
+		flags = key->flags ? key->flags : option_mask32;
+		if (!x->kv[i].str) {
+			double dx = x->kv[i].num;
+			double dy = y->kv[i].num;
+			retval = (dx > dy) ? 1 : ((dx < dy) ? -1 : 0);
+		} else {
+			retval = compare_key(x->kv[i].str, y->kv[i].str, flags);
+		}
+	}
+
+	return finish_compare(retval, flags, x->line, y->line);
+}
+
+#if ENABLE_FEATURE_SORT_PARALLEL
+static unsigned sort_procs;
+
+/* Merge sorted a[na] and b[nb] into dst. On ties, a goes first */
+static void merge_recs(struct sort_rec *dst,
+		struct sort_rec *a, unsigned na,
+		struct sort_rec *b, unsigned nb)
+{
+	while (na && nb) {
+		if (compare_recs(b, a) < 0) {
+			*dst++ = *b++;
+			nb--;
+		} else {
+			*dst++ = *a++;
+			na--;
+		}
+	}
+	memcpy(dst, a, na * sizeof(*a));
+	memcpy(dst + na, b, nb * sizeof(*b));
+}
+
+/* Split recs[] into sort_procs parts, sort them in shared memory
+ * by worker processes (we sort part 0 ourself), merge the parts */
+static void sort_recs_parallel(struct sort_rec *recs, unsigned n)
+{
+	struct sort_rec *shared, *src, *dst;
+	unsigned *bound;
+	pid_t *pids;
+	unsigned nparts, i;
+
+	shared = mmap(NULL, n * sizeof(recs[0]), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED) {
+		qsort(recs, n, sizeof(recs[0]), compare_recs);
+		return;
+	}
+	memcpy(shared, recs, n * sizeof(recs[0]));
+
+	nparts = sort_procs;
+	bound = xmalloc((nparts + 1) * sizeof(bound[0]));
+	pids = xmalloc(nparts * sizeof(pids[0]));
+	for (i = 0; i <= nparts; i++)
+		bound[i] = (unsigned long long)n * i / nparts;
+	fflush_all();
+	for (i = 1; i < nparts; i++) {
+		pids[i] = xfork();
+		if (pids[i] == 0) {
+			qsort(shared + bound[i], bound[i+1] - bound[i],
+				sizeof(recs[0]), compare_recs);
+			_exit(EXIT_SUCCESS);
+		}
+	}
+	qsort(shared, bound[1], sizeof(recs[0]), compare_recs);
+	for (i = 1; i < nparts; i++) {
+		int status;
+		/* A worker has died (after printing error message, presumably) */
+		if (safe_waitpid(pids[i], &status, 0) < 0 || status != 0)
+			xfunc_die();
+	}
+
+	/* Merge adjacent pairs of parts until one is left */
+	src = shared;
+	dst = recs;
+	while (nparts > 1) {
+		struct sort_rec *t;
+		unsigned j = 0;
+
+		for (i = 0; i < nparts; i += 2) {
+			unsigned lo = bound[i];
+			unsigned mid = bound[i+1];
+			unsigned hi = (i + 2 <= nparts) ? bound[i+2] : mid;
+			merge_recs(dst + lo, src + lo, mid - lo, src + mid, hi - mid);
+			bound[j++] = lo;
+		}
+		bound[j] = n;
+		nparts = j;
+		t = src;
+		src = dst;
+		dst = t;
+	}
+	if (src != recs)
+		memcpy(recs, src, n * sizeof(recs[0]));
+
+	free(pids);
+	free(bound);
+	munmap(shared, n * sizeof(recs[0]));
+}
+#endif
+
+static void sort_recs(struct sort_rec *recs, unsigned n)
+{
+#if ENABLE_FEATURE_SORT_PARALLEL
+	/* Do not bother forking for small inputs */
+	if (sort_procs > 1 && n / sort_procs >= 4 * 1024) {
+		sort_recs_parallel(recs, n);
+		return;
+	}
+#endif
+	qsort(recs, n, sizeof(recs[0]), compare_recs);
+}
+#endif
+
+/* Sort lines, handle -u. Returns new line count */
+static int sort_lines(char **lines, int linecount)
+{
+	int i;
+#if ENABLE_FEATURE_SORT_BIG
+	struct sort_rec *recs;
+	struct key_val *kv;
+
+	recs = xmalloc(linecount * sizeof(recs[0]));
+	kv = xmalloc(linecount * key_count * sizeof(kv[0]));
+	for (i = 0; i < linecount; i++)
+		make_rec(&recs[i], lines[i], kv + i * key_count);
+	sort_recs(recs, linecount);
+	for (i = 0; i < linecount; i++) {
+		lines[i] = recs[i].line;
+		free_rec_keys(&recs[i]);
+	}
+	free(kv);
+	free(recs);
+#else
+	qsort(lines, linecount, sizeof(lines[0]), compare_keys);
+#endif
+
+	if (option_mask32 & FLAG_u) {
+		unsigned saved_opts = option_mask32;
+		int j = 0;
+		/* coreutils 6.3 drop lines for which only key is the same */
+		/* -- disabling last-resort compare... */
+		option_mask32 |= FLAG_s;
+		for (i = 1; i < linecount; i++) {
+			if (compare_keys(&lines[j], &lines[i]) == 0)
+				free(lines[i]);
+			else
+				lines[++j] = lines[i];
+		}
+		option_mask32 = saved_opts;
+		if (linecount)
+			linecount = j+1;
+	}
+	return linecount;
+}
+
+#if ENABLE_FEATURE_SORT_EXTERNAL
+/* Input which does not fit into -S SIZE bytes is sorted in chunks.
+ * Every sorted chunk (a "run") goes to an unlinked temporary file.
+ * At EOF, all runs and the last chunk, still in memory, are merged
+ * using a heap. -m feeds input files to the same merge code.
+ */
+enum { MAX_MERGE = 32 }; /* runs merged at once */
+
+struct run {
+	FILE *fp;          /* NULL: not opened yet */
+	const char *name;  /* input file (-m), NULL for temporary files */
+	unsigned level;    /* how many merges this run went through */
+};
+
+struct merge_src {
+	FILE *fp;          /* NULL: lines come from lines[] */
+	char **lines;
+	unsigned cnt;
+	unsigned idx;      /* on equal lines, lower idx goes first */
+	char *line;
+};
+
+static const char *tmp_dir;
+static struct run *runs;
+static unsigned nruns;
+
+static const struct suffix_mult sort_size_suffixes[] = {
+	{ "b", 1 },
+	{ "k", 1024 },
+	{ "K", 1024 },
+	{ "M", 1024*1024 },
+	{ "G", 1024*1024*1024 },
+	{ "", 0 }
+};
+
+/* -S SIZE: kbytes by default, or N% of physical memory */
+static size_t get_mem_limit(const char *str)
+{
+	unsigned long long ram, size;
+	long pages;
+	size_t len;
+
+	pages = sysconf(_SC_PHYS_PAGES);
+	ram = (pages > 0) ? (unsigned long long)pages * getpagesize() : 0;
+	if (!str) {
+		/* Default: 1/8 of RAM */
+		size = ram / 8;
+		if (size < 1024*1024)
+			size = 64*1024*1024;
+	} else {
+		len = strlen(str);
+		if (len && str[len-1] == '%') {
+			char *num = xstrndup(str, len-1);
+			size = ram / 100 * xatou_range(num, 1, 100);
+			free(num);
+		} else if (len && isdigit(str[len-1])) {
+			size = xatoull_range(str, 0, ULLONG_MAX / 1024) * 1024;
+		} else {
+			size = xatoull_sfx(str, sort_size_suffixes);
+		}
+	}
+	if (size > (size_t)-1 / 2)
+		size = (size_t)-1 / 2;
+	return size;
+}
+
+static FILE *xtmpfile(void)
+{
+	char *name = concat_path_file(tmp_dir, "sortXXXXXX");
+	int fd = xmkstemp(name);
+	FILE *fp;
+
+	unlink(name);
+	free(name);
+	fp = fdopen(fd, "w+");
+	if (!fp)
+		bb_error_msg_and_die(bb_msg_memory_exhausted);
+	return fp;
+}
+
+static void put_line(FILE *fp, const char *line)
+{
+	fputs(line, fp);
+	putc((option_mask32 & FLAG_z) ? '\0' : '\n', fp);
+}
+
+static void rewind_run(FILE *fp)
+{
+	fflush(fp);
+	die_if_ferror(fp, tmp_dir);
+	rewind(fp);
+}
+
+static char *next_line(struct merge_src *src)
+{
+	if (src->fp)
+		return GET_LINE(src->fp);
+	if (!src->cnt)
+		return NULL;
+	src->cnt--;
+	return *src->lines++;
+}
+
+static int compare_srcs(struct merge_src *a, struct merge_src *b)
+{
+	int retval = compare_keys(&a->line, &b->line);
+	if (!retval)
+		retval = (a->idx < b->idx) ? -1 : 1;
+	return retval;
+}
+
+static void sift_down(struct merge_src **heap, unsigned n, unsigned i)
+{
+	for (;;) {
+		struct merge_src *t;
+		unsigned c = 2*i + 1;
+
+		if (c >= n)
+			break;
+		if (c + 1 < n && compare_srcs(heap[c+1], heap[c]) < 0)
+			c++;
+		if (compare_srcs(heap[i], heap[c]) < 0)
+			break;
+		t = heap[i];
+		heap[i] = heap[c];
+		heap[c] = t;
+		i = c;
+	}
+}
+
+/* Merge n runs and then lines[cnt] into out, close the runs */
+static void merge_runs(struct run *r, unsigned n, char **lines, unsigned cnt, FILE *out)
+{
+	struct merge_src *src, **heap;
+	char *last = NULL;
+	unsigned i, nheap;
+
+	src = xzalloc((n + 1) * sizeof(src[0]));
+	heap = xmalloc((n + 1) * sizeof(heap[0]));
+	nheap = 0;
+	for (i = 0; i <= n; i++) {
+		if (i < n) {
+			if (!r[i].fp)
+				r[i].fp = xfopen_stdin(r[i].name);
+			src[i].fp = r[i].fp;
+		} else {
+			src[i].lines = lines;
+			src[i].cnt = cnt;
+		}
+		src[i].idx = i;
+		src[i].line = next_line(&src[i]);
+		if (src[i].line)
+			heap[nheap++] = &src[i];
+	}
+	for (i = nheap / 2; i-- != 0;)
+		sift_down(heap, nheap, i);
+
+	while (nheap) {
+		struct merge_src *top = heap[0];
+		char *line = top->line;
+
+		if (!(option_mask32 & FLAG_u)) {
+			put_line(out, line);
+			free(line);
+		} else {
+			unsigned saved_opts = option_mask32;
+			int retval = 1;
+
+			/* -u compares only keys, see sort_lines() */
+			option_mask32 |= FLAG_s;
+			if (last)
+				retval = compare_keys(&last, &line);
+			option_mask32 = saved_opts;
+			if (retval) {
+				put_line(out, line);
+				free(last);
+				last = line;
+			} else {
+				free(line);
+			}
+		}
+		top->line = next_line(top);
+		if (!top->line)
+			heap[0] = heap[--nheap];
+		sift_down(heap, nheap, 0);
+	}
+	free(last);
+
+	for (i = 0; i < n; i++) {
+		if (r[i].name)
+			fclose_if_not_stdin(r[i].fp);
+		else
+			fclose(r[i].fp);
+	}
+	free(heap);
+	free(src);
+}
+
+/* Replace MAX_MERGE runs starting from first by their merge */
+static void merge_batch(unsigned first)
+{
+	FILE *fp = xtmpfile();
+
+	merge_runs(runs + first, MAX_MERGE, NULL, 0, fp);
+	rewind_run(fp);
+	runs[first].fp = fp;
+	runs[first].name = NULL;
+	runs[first].level++;
+	nruns -= MAX_MERGE - 1;
+	memmove(&runs[first + 1], &runs[first + MAX_MERGE],
+		(nruns - first - 1) * sizeof(runs[0]));
+}
+
+static void write_run(char **lines, int linecount)
+{
+	FILE *fp = xtmpfile();
+	int i;
+
+	for (i = 0; i < linecount; i++) {
+		put_line(fp, lines[i]);
+		free(lines[i]);
+	}
+	rewind_run(fp);
+	runs = xrealloc_vector(runs, 4, nruns);
+	runs[nruns++].fp = fp;
+	/* Do not run out of file descriptors on huge inputs:
+	 * as soon as there are MAX_MERGE runs of the same level,
+	 * merge them. Then no more than (MAX_MERGE-1) * log(N) runs
+	 * exist, and every line is merged log(N) times */
+	while (nruns >= MAX_MERGE
+	 && runs[nruns - MAX_MERGE].level == runs[nruns - 1].level
+	) {
+		merge_batch(nruns - MAX_MERGE);
+	}
+}
+
+static void merge_all(char **lines, unsigned cnt, FILE *out)
+{
+	/* Too many runs? Merge them in batches. A batch is replaced
+	 * by one run in the same position, this keeps -s stable */
+	while (nruns > MAX_MERGE)
+		merge_batch(0);
+	merge_runs(runs, nruns, lines, cnt, out);
+}
+
+/* -m -o FILE where FILE is one of inputs can't be merged on the fly */
+static int output_is_input(const char *out, char **argv)
+{
+	struct stat ost, ist;
+
+	if (!(option_mask32 & FLAG_o) || stat(out, &ost) != 0)
+		return 0;
+	do {
+		if (stat(*argv, &ist) == 0
+		 && ist.st_dev == ost.st_dev && ist.st_ino == ost.st_ino
+		) {
+			return 1;
+		}
+	} while (*++argv);
+	return 0;
+}
+#endif
+
 int sort_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int sort_main(int argc UNUSED_PARAM, char **argv)
 {
 	char *line, **lines;
-	char *str_ignored, *str_o, *str_t;
+	char *str_S, *str_T, *str_o, *str_t;
+	IF_FEATURE_SORT_PARALLEL(char *str_parallel;)
 	llist_t *lst_k = NULL;
 	int i;
 	int linecount;
 	unsigned opts;
+#if ENABLE_FEATURE_SORT_EXTERNAL
+	size_t mem, mem_limit;
+#endif
 
 	xfunc_error_retval = 2;
 
 	/* Parse command line options */
 	/* -o and -t can be given at most once */
 	opt_complementary = "o--o:t--t"; /* -t, -o: at most one of each */
-	opts = getopt32(argv, OPT_STR, &str_ignored, &str_ignored, &str_o, &lst_k, &str_t);
+#if ENABLE_FEATURE_SORT_PARALLEL
+	applet_long_options = "parallel\0" Required_argument "\xff";
+#endif
+	opts = getopt32(argv, OPT_STR, &str_S, &str_T, &str_o, &lst_k, &str_t
+			IF_FEATURE_SORT_PARALLEL(, &str_parallel));
 	/* global b strips leading and trailing spaces */
 	if (opts & FLAG_b)
 		option_mask32 |= FLAG_bb;
@@ -423,10 +948,75 @@ int sort_main(int argc UNUSED_PARAM, char **argv)
 	}
 #endif
 
-	/* Open input files and read data */
 	argv += optind;
 	if (!*argv)
 		*--argv = (char*)"-";
+#if ENABLE_FEATURE_SORT_BIG
+	/* If no key, perform alphabetic sort */
+	if (!key_list)
+		add_key()->range[0] = 1;
+	{
+		struct sort_key *key;
+		for (key = key_list; key; key = key->next_key)
+			key_count++;
+		/* With strcoll(), comparing bytes is wrong */
+		use_prefix = !ENABLE_LOCALE_SUPPORT
+			&& !((key_list->flags ? key_list->flags : option_mask32)
+				& (FLAG_n | FLAG_M | FLAG_g));
+	}
+# if ENABLE_FEATURE_SORT_PARALLEL
+	sort_procs = 1;
+	if (option_mask32 & FLAG_parallel) {
+		sort_procs = xatou_range(str_parallel, 0, 1024);
+		if (sort_procs == 0)
+			sort_procs = get_cpu_count();
+	}
+# endif
+	/* Handle -c: only the previous line needs to be kept */
+	if (option_mask32 & FLAG_c) {
+		int j = (option_mask32 & FLAG_u) ? -1 : 0;
+		char *prev = NULL;
+
+		i = 0;
+		do {
+			FILE *fp = xfopen_stdin(*argv);
+			while ((line = GET_LINE(fp)) != NULL) {
+				if (prev && compare_keys(&prev, &line) > j) {
+					fprintf(stderr, "Check line %u\n", i);
+					return EXIT_FAILURE;
+				}
+				free(prev);
+				prev = line;
+				i++;
+			}
+			fclose_if_not_stdin(fp);
+		} while (*++argv);
+		return EXIT_SUCCESS;
+	}
+#endif
+#if ENABLE_FEATURE_SORT_EXTERNAL
+	tmp_dir = str_T;
+	if (!(option_mask32 & FLAG_T)) {
+		tmp_dir = getenv("TMPDIR");
+		if (!tmp_dir)
+			tmp_dir = "/tmp";
+	}
+	mem_limit = get_mem_limit((option_mask32 & FLAG_S) ? str_S : NULL);
+	mem = 0;
+
+	if ((option_mask32 & FLAG_m) && !output_is_input(str_o, argv)) {
+		while (*argv) {
+			runs = xrealloc_vector(runs, 4, nruns);
+			runs[nruns++].name = *argv++;
+		}
+		if (option_mask32 & FLAG_o)
+			xmove_fd(xopen(str_o, O_WRONLY|O_CREAT|O_TRUNC), STDOUT_FILENO);
+		merge_all(NULL, 0, stdout);
+		fflush_stdout_and_exit(EXIT_SUCCESS);
+	}
+#endif
+
+	/* Open input files and read data */
 	linecount = 0;
 	lines = NULL;
 	do {
@@ -439,50 +1029,35 @@ int sort_main(int argc UNUSED_PARAM, char **argv)
 				break;
 			lines = xrealloc_vector(lines, 6, linecount);
 			lines[linecount++] = line;
+#if ENABLE_FEATURE_SORT_EXTERNAL
+			/* the line, pointer to it, malloc overhead, sort_rec */
+			mem += strlen(line) + 1 + 3 * sizeof(line)
+				+ sizeof(struct sort_rec) + key_count * sizeof(struct key_val);
+			if (mem > mem_limit) {
+				linecount = sort_lines(lines, linecount);
+				write_run(lines, linecount);
+				linecount = 0;
+				mem = 0;
+			}
+#endif
 		}
 		fclose_if_not_stdin(fp);
 	} while (*++argv);
 
-#if ENABLE_FEATURE_SORT_BIG
-	/* If no key, perform alphabetic sort */
-	if (!key_list)
-		add_key()->range[0] = 1;
-	/* Handle -c */
-	if (option_mask32 & FLAG_c) {
-		int j = (option_mask32 & FLAG_u) ? -1 : 0;
-		for (i = 1; i < linecount; i++) {
-			if (compare_keys(&lines[i-1], &lines[i]) > j) {
-				fprintf(stderr, "Check line %u\n", i);
-				return EXIT_FAILURE;
-			}
-		}
-		return EXIT_SUCCESS;
-	}
-#endif
 	/* Perform the actual sort */
-	qsort(lines, linecount, sizeof(lines[0]), compare_keys);
-
-	/* Handle -u */
-	if (option_mask32 & FLAG_u) {
-		int j = 0;
-		/* coreutils 6.3 drop lines for which only key is the same */
-		/* -- disabling last-resort compare... */
-		option_mask32 |= FLAG_s;
-		for (i = 1; i < linecount; i++) {
-			if (compare_keys(&lines[j], &lines[i]) == 0)
-				free(lines[i]);
-			else
-				lines[++j] = lines[i];
-		}
-		if (linecount)
-			linecount = j+1;
-	}
+	linecount = sort_lines(lines, linecount);
 
 	/* Print it */
 #if ENABLE_FEATURE_SORT_BIG
 	/* Open output file _after_ we read all input ones */
 	if (option_mask32 & FLAG_o)
 		xmove_fd(xopen(str_o, O_WRONLY|O_CREAT|O_TRUNC), STDOUT_FILENO);
+#endif
+#if ENABLE_FEATURE_SORT_EXTERNAL
+	if (nruns) {
+		merge_all(lines, linecount, stdout);
+		fflush_stdout_and_exit(EXIT_SUCCESS);
+	}
 #endif
 	{
 		int ch = (option_mask32 & FLAG_z) ? '\0' : '\n';
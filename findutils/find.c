@@ -235,6 +235,15 @@
 //config:	depends on FIND
 //config:	help
 //config:	  Support the 'find -links' option for matching number of links.
+//config:
+//config:config FEATURE_FIND_PARALLEL
+//config:	bool "Enable -j N: search subdirectories in parallel"
+//config:	default y
+//config:	depends on FIND && !NOMMU
+//config:	help
+//config:	  Split the tree into subtrees and search them in several
+//config:	  worker processes at once. Helps when stat() is slow,
+//config:	  e.g. on network filesystems. Output is the same as without -j.
 
 //applet:IF_FIND(APPLET_NOEXEC(find, find, BB_DIR_USR_BIN, BB_SUID_DROP, find))
 
@@ -259,6 +268,9 @@
 //usage:	IF_FEATURE_FIND_DEPTH(
 //usage:     "\n	-depth		Act on directory *after* traversing it"
 //usage:	)
+//usage:	IF_FEATURE_FIND_PARALLEL(
+//usage:     "\n	-j N		Search N subdirectories at once (0: one per CPU)"
+//usage:	)
 //usage:     "\n"
 //usage:     "\nActions:"
 //usage:	IF_FEATURE_FIND_PAREN(
@@ -421,6 +433,7 @@ struct globals {
 	smallint xdev_on;
 	recurse_flags_t recurse_flags;
 	IF_FEATURE_FIND_EXEC_PLUS(unsigned max_argv_len;)
+	IF_FEATURE_FIND_PARALLEL(unsigned nproc;)
 } FIX_ALIASING;
 #define G (*(struct globals*)bb_common_bufsiz1)
 #define INIT_G() do { \
@@ -430,6 +443,7 @@ struct globals {
 	memset(&G, 0, sizeof(G)); \
 	IF_FEATURE_FIND_MAXDEPTH(G.minmaxdepth[1] = INT_MAX;) \
 	IF_FEATURE_FIND_EXEC_PLUS(G.max_argv_len = bb_arg_max() - 2048;) \
+	IF_FEATURE_FIND_PARALLEL(G.nproc = 1;) \
 	G.need_print = 1; \
 	G.recurse_flags = ACTION_RECURSE; \
 } while (0)
@@ -862,6 +876,205 @@ static int FAST_FUNC fileAction(const char *fileName,
 	return (r & SKIP) ? SKIP : TRUE;
 }
 
+#if ENABLE_FEATURE_FIND_PARALLEL
+/* find -j N: the tree is cut into jobs, and jobs are run in worker
+ * processes by run_parallel_ordered(), which prints their output
+ * in job order. Jobs are listed in the order a serial walk would
+ * visit them, thus output is the same as without -j.
+ */
+struct find_job {
+	char *path;
+	int depth;
+	smallint node_only; /* act on directory itself only, st is valid */
+	struct stat st;
+};
+struct job_list {
+	struct find_job *job;
+	unsigned cnt;
+};
+
+enum {
+	SPLIT_NO_SUBDIRS = 1, /* actions can affect traversal or the tree */
+	SPLIT_NO_JOBS    = 2, /* actions need to see all files */
+};
+static int split_flags(action ***appp)
+{
+	int r = 0;
+	action **app, *ap;
+
+	while ((app = *appp++) != NULL) {
+		while ((ap = *app++) != NULL) {
+# if ENABLE_FEATURE_FIND_PAREN
+			if (ap->f == (action_fp)func_paren)
+				r |= split_flags(((action_paren*)ap)->subexpr);
+# endif
+# if ENABLE_FEATURE_FIND_PRUNE
+			if (ap->f == (action_fp)func_prune)
+				r |= SPLIT_NO_SUBDIRS;
+# endif
+# if ENABLE_FEATURE_FIND_DELETE
+			if (ap->f == (action_fp)func_delete)
+				r |= SPLIT_NO_SUBDIRS;
+# endif
+# if ENABLE_FEATURE_FIND_EXEC
+			if (ap->f == (action_fp)func_exec) {
+				r |= SPLIT_NO_SUBDIRS;
+#  if ENABLE_FEATURE_FIND_EXEC_PLUS
+				if (((action_exec*)ap)->filelist)
+					r |= SPLIT_NO_JOBS;
+#  endif
+			}
+# endif
+		}
+	}
+	return r;
+}
+
+static void add_job(struct job_list *jl, char *path, int depth,
+		const struct stat *st)
+{
+	struct find_job *j;
+
+	jl->job = xrealloc_vector(jl->job, 4, jl->cnt);
+	j = &jl->job[jl->cnt++];
+	j->path = path;
+	j->depth = depth;
+	j->node_only = (st != NULL);
+	if (st)
+		j->st = *st;
+}
+
+/* Add a job for each entry of dir. Same order as recursive_action()'s */
+static int add_dir_jobs(struct job_list *jl, const char *dir, int depth)
+{
+	DIR *dp;
+	struct dirent *de;
+
+	dp = opendir(dir);
+	if (!dp)
+		return 0;
+	while ((de = readdir(dp)) != NULL) {
+		char *path = concat_subpath_file(dir, de->d_name);
+		if (path)
+			add_job(jl, path, depth, NULL);
+	}
+	closedir(dp);
+	return 1;
+}
+
+/* Replace subtree jobs by "this dir only" job plus jobs for its
+ * entries, level by level, until there are enough jobs */
+static void split_jobs(struct job_list *jl, unsigned want)
+{
+	while (jl->cnt < want) {
+		struct job_list out;
+		unsigned i;
+		int split = 0;
+
+		out.job = NULL;
+		out.cnt = 0;
+		for (i = 0; i < jl->cnt; i++) {
+			struct find_job *j = &jl->job[i];
+			struct stat st;
+
+			if (!j->node_only
+# if ENABLE_FEATURE_FIND_MAXDEPTH
+			 && j->depth < G.minmaxdepth[1]
+# endif
+			 && ((G.recurse_flags & ACTION_FOLLOWLINKS) ? stat : lstat)(j->path, &st) == 0
+			 && S_ISDIR(st.st_mode)
+			) {
+				unsigned cnt = out.cnt;
+				add_job(&out, j->path, j->depth, &st);
+				if (add_dir_jobs(&out, j->path, j->depth + 1)) {
+					split = 1;
+					continue;
+				}
+				out.cnt = cnt; /* can't read it: leave it to the job */
+			}
+			add_job(&out, j->path, j->depth, j->node_only ? &j->st : NULL);
+		}
+		free(jl->job);
+		*jl = out;
+		if (!split)
+			break;
+	}
+}
+
+static int FAST_FUNC find_job(unsigned idx, void *arg)
+{
+	struct find_job *j = &((struct job_list *)arg)->job[idx];
+
+	if (j->node_only) {
+		fileAction(j->path, &j->st, NULL, j->depth);
+		return EXIT_SUCCESS;
+	}
+	if (!recursive_action(j->path, G.recurse_flags,
+			fileAction, fileAction, NULL, j->depth)
+	) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+static int find_parallel(const char *root, int flags)
+{
+	struct job_list jl;
+	struct stat st;
+	int *status;
+	unsigned i;
+	int ret = EXIT_SUCCESS;
+
+	/* Not a dir (or an error)? Nothing to do in parallel */
+	if (((G.recurse_flags & (ACTION_FOLLOWLINKS | ACTION_FOLLOWLINKS_L0)) ? stat : lstat)(root, &st) != 0
+	 || !S_ISDIR(st.st_mode)
+	) {
+		goto serial;
+	}
+
+	/* Act on root in this process: before anything else, and before
+	 * any job starts, or after all jobs are done (-depth).
+	 * Its result decides whether we descend at all */
+	if (!(G.recurse_flags & ACTION_DEPTHFIRST)) {
+		if (fileAction(root, &st, NULL, 0) == SKIP)
+			return ret;
+	}
+
+	jl.job = NULL;
+	jl.cnt = 0;
+	if (!add_dir_jobs(&jl, root, 1)) {
+		bb_simple_perror_msg(root);
+		return EXIT_FAILURE;
+	}
+	/* Deeper dirs may be acted upon in parallel with their contents.
+	 * Only do that if actions don't change the tree or traversal */
+	if (!(flags & SPLIT_NO_SUBDIRS)
+	 && !(G.recurse_flags & ACTION_DEPTHFIRST)
+	 && !G.xdev_on
+	) {
+		split_jobs(&jl, G.nproc * 8);
+	}
+
+	status = xzalloc(jl.cnt * sizeof(status[0]));
+	run_parallel_ordered(jl.cnt, G.nproc, find_job, &jl, status);
+	for (i = 0; i < jl.cnt; i++) {
+		ret |= status[i];
+		free(jl.job[i].path);
+	}
+	free(jl.job);
+	free(status);
+
+	if (G.recurse_flags & ACTION_DEPTHFIRST)
+		fileAction(root, &st, NULL, 0);
+	return ret;
+
+ serial:
+	if (!recursive_action(root, G.recurse_flags, fileAction, fileAction, NULL, 0))
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+#endif
+
 
 #if ENABLE_FEATURE_FIND_TYPE
 static int find_type(const char *type)
@@ -969,6 +1182,7 @@ static action*** parse_params(char **argv)
 	IF_FEATURE_FIND_CONTEXT(PARM_context   ,)
 	IF_FEATURE_FIND_LINKS(  PARM_links     ,)
 	IF_FEATURE_FIND_MAXDEPTH(OPT_MINDEPTH,OPT_MAXDEPTH,)
+	IF_FEATURE_FIND_PARALLEL(OPT_PARALLEL  ,)
 	};
 
 	static const char params[] ALIGN1 =
@@ -1010,6 +1224,7 @@ static action*** parse_params(char **argv)
 	IF_FEATURE_FIND_CONTEXT("-context\0")
 	IF_FEATURE_FIND_LINKS(  "-links\0"  )
 	IF_FEATURE_FIND_MAXDEPTH("-mindepth\0""-maxdepth\0")
+	IF_FEATURE_FIND_PARALLEL("-j\0"     )
 	;
 
 #if !USE_NESTED_FUNCTION
@@ -1092,6 +1307,14 @@ static action*** parse_params(char **argv)
 			G.recurse_flags |= ACTION_DEPTHFIRST;
 		}
 #endif
+#if ENABLE_FEATURE_FIND_PARALLEL
+		else if (parm == OPT_PARALLEL) {
+			dbg("%d", __LINE__);
+			G.nproc = xatoi_positive(arg1);
+			if (G.nproc == 0)
+				G.nproc = get_cpu_count();
+		}
+#endif
 /* Actions are grouped by operators
  * ( expr )              Force precedence
  * ! expr                True if expr is false
@@ -1391,6 +1614,7 @@ int find_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int find_main(int argc UNUSED_PARAM, char **argv)
 {
 	int i, firstopt, status = EXIT_SUCCESS;
+	IF_FEATURE_FIND_PARALLEL(int flags;)
 	char **past_HLP, *saved;
 
 	INIT_G();
@@ -1456,7 +1680,20 @@ int find_main(int argc UNUSED_PARAM, char **argv)
 	}
 #endif
 
+#if ENABLE_FEATURE_FIND_PARALLEL
+	flags = split_flags(G.actions);
+	/* -exec CMD {} + collects names from all files */
+	if (flags & SPLIT_NO_JOBS)
+		G.nproc = 1;
+#endif
+
 	for (i = 0; argv[i]; i++) {
+#if ENABLE_FEATURE_FIND_PARALLEL
+		if (G.nproc > 1) {
+			status |= find_parallel(argv[i], flags);
+			continue;
+		}
+#endif
 		if (!recursive_action(argv[i],
 				G.recurse_flags,/* flags */
 				fileAction,     /* file action */
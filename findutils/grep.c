@@ -56,6 +56,26 @@
 //config:	  Print the specified number of leading (-B) and/or trailing (-A)
 //config:	  context surrounding our matching lines.
 //config:	  Print the specified number of context lines (-C).
+//config:
+//config:config FEATURE_GREP_FAST
+//config:	bool "Fast search for literal strings"
+//config:	default y
+//config:	depends on GREP && !EXTRA_COMPAT
+//config:	help
+//config:	  When every pattern contains a literal string which any match
+//config:	  must contain (-F patterns, or "ERROR" in "ERROR.*disk"),
+//config:	  search whole input buffer for these strings and run
+//config:	  regexp matching only on lines which have them.
+//config:	  Many -F patterns are searched for at once.
+//config:
+//config:config FEATURE_GREP_PARALLEL
+//config:	bool "Enable -j N option to search files in parallel with -r"
+//config:	default y
+//config:	depends on GREP && !NOMMU
+//config:	help
+//config:	  With -r, search several files at once in worker processes.
+//config:	  Output of each file is kept together, in the same order
+//config:	  as without -j.
 
 #include "libbb.h"
 #include "common_bufsiz.h"
@@ -70,6 +90,7 @@
 //usage:	IF_EXTRA_COMPAT("z")
 //usage:       "] [-m N] "
 //usage:	IF_FEATURE_GREP_CONTEXT("[-A/B/C N] ")
+//usage:	IF_FEATURE_GREP_PARALLEL("[-j N] ")
 //usage:       "PATTERN/-e PATTERN.../-f FILE [FILE]..."
 //usage:#define grep_full_usage "\n\n"
 //usage:       "Search for PATTERN in FILEs (or stdin)\n"
@@ -84,6 +105,9 @@
 //usage:     "\n	-v	Select non-matching lines"
 //usage:     "\n	-s	Suppress open and read errors"
 //usage:     "\n	-r	Recurse"
+//usage:	IF_FEATURE_GREP_PARALLEL(
+//usage:     "\n	-j N	With -r, search N files at once (0: one per CPU)"
+//usage:	)
 //usage:     "\n	-i	Ignore case"
 //usage:     "\n	-w	Match whole words only"
 //usage:     "\n	-x	Match whole lines only"
@@ -119,6 +143,7 @@
 	IF_FEATURE_GREP_CONTEXT("A:+B:+C:+") \
 	IF_FEATURE_GREP_EGREP_ALIAS("E") \
 	IF_EXTRA_COMPAT("z") \
+	IF_FEATURE_GREP_PARALLEL("j:+") \
 	"aI"
 /* ignored: -a "assume all files to be text" */
 /* ignored: -I "assume binary files have no matches" */
@@ -146,6 +171,7 @@ enum {
 	IF_FEATURE_GREP_CONTEXT(    OPTBIT_C ,) /* -C NUM: -A and -B combined */
 	IF_FEATURE_GREP_EGREP_ALIAS(OPTBIT_E ,) /* extended regexp */
 	IF_EXTRA_COMPAT(            OPTBIT_z ,) /* input is NUL terminated */
+	IF_FEATURE_GREP_PARALLEL(   OPTBIT_j ,) /* -j NPROC */
 	OPT_l = 1 << OPTBIT_l,
 	OPT_n = 1 << OPTBIT_n,
 	OPT_q = 1 << OPTBIT_q,
@@ -169,6 +195,7 @@ enum {
 	OPT_C = IF_FEATURE_GREP_CONTEXT(    (1 << OPTBIT_C)) + 0,
 	OPT_E = IF_FEATURE_GREP_EGREP_ALIAS((1 << OPTBIT_E)) + 0,
 	OPT_z = IF_EXTRA_COMPAT(            (1 << OPTBIT_z)) + 0,
+	OPT_j = IF_FEATURE_GREP_PARALLEL(   (1 << OPTBIT_j)) + 0,
 };
 
 #define PRINT_FILES_WITH_MATCHES    (option_mask32 & OPT_l)
@@ -201,6 +228,12 @@ struct globals {
 	/* globals used internally */
 	llist_t *pattern_head;   /* growable list of patterns to match */
 	const char *cur_file;    /* the current file we are reading */
+#if ENABLE_FEATURE_GREP_FAST
+	struct fast_match *fast; /* NULL if not usable for these patterns */
+#endif
+#if ENABLE_FEATURE_GREP_PARALLEL
+	int nproc;               /* -r: grep this many files at once */
+#endif
 } FIX_ALIASING;
 #define G (*(struct globals*)bb_common_bufsiz1)
 #define INIT_G() do { \
@@ -307,6 +340,390 @@ static ssize_t FAST_FUNC bb_getline(char **line_ptr, size_t *line_alloc_len, FIL
 }
 #endif
 
+static void compile_pattern(grep_list_data_t *gl)
+{
+	if (!(gl->flg_mem_allocated_compiled & COMPILED)) {
+		gl->flg_mem_allocated_compiled |= COMPILED;
+#if !ENABLE_EXTRA_COMPAT
+		xregcomp(&gl->compiled_regex, gl->pattern, reflags);
+#else
+		memset(&gl->compiled_regex, 0, sizeof(gl->compiled_regex));
+		gl->compiled_regex.translate = case_fold; /* for -i */
+		if (re_compile_pattern(gl->pattern, strlen(gl->pattern), &gl->compiled_regex))
+			bb_error_msg_and_die("bad regex '%s'", gl->pattern);
+#endif
+	}
+}
+
+#if ENABLE_FEATURE_GREP_FAST
+/* If every pattern can match only lines which contain a literal
+ * string (a "needle"), we look for needles in the whole read buffer
+ * (memmem() for one needle, Aho-Corasick automaton for many)
+ * and skip all lines without them. Only lines with a needle
+ * are returned to grep_file() for regexec()/strstr().
+ */
+struct ac_node {
+	int child;        /* first child, 0 if none */
+	int sibling;      /* next child of the same parent */
+	int fail;         /* node of the longest proper suffix */
+	unsigned char ch;
+	smallint out;     /* a needle ends here, or at a suffix of it */
+};
+
+struct fast_match {
+	char *buf;
+	size_t bufsize, start, end;
+	smallint eof;
+	smallint exact;   /* -F: a line with a needle does match */
+	smallint has_nul; /* NUL was seen: it ends a line too, as in xmalloc_fgetline */
+	/* One case-sensitive needle */
+	char *needle;
+	size_t needle_len;
+	/* Otherwise, Aho-Corasick. node[0] is root */
+	struct ac_node *node;
+	int node_cnt;
+	int root_next[256];
+	unsigned char fold[256];
+};
+
+/* Returns malloced longest literal string which any match
+ * of the regex must contain, or NULL. Errs on the safe side:
+ * anything special ends a literal, quantified chars are dropped,
+ * alternation at top level means "no literal" */
+static char *required_literal(const char *p, int ere)
+{
+	const char *special = ere ? ".[\\*^$+?{}()|" : ".[\\*^$";
+	char *cur, *best;
+	unsigned cur_len, best_len;
+	int depth;
+
+	cur = xmalloc(strlen(p) + 1);
+	best = xzalloc(strlen(p) + 1);
+	cur_len = best_len = 0;
+	depth = 0;
+	for (;; p++) {
+		char c = *p;
+
+		if (c && depth == 0 && !strchr(special, c) && c != '\n') {
+			cur[cur_len++] = c;
+			continue;
+		}
+		/* Quantifier makes previous char optional */
+		if (c == '*' || (ere && c && strchr("+?{", c))
+		 || (!ere && c == '\\' && p[1] && strchr("{?+", p[1]))
+		) {
+			if (cur_len)
+				cur_len--;
+		}
+		if (cur_len > best_len) {
+			memcpy(best, cur, cur_len);
+			best[cur_len] = '\0';
+			best_len = cur_len;
+		}
+		cur_len = 0;
+		if (!c)
+			break;
+
+		if (c == '[') {
+			/* Skip bracket expression */
+			p++;
+			if (*p == '^')
+				p++;
+			if (*p == ']')
+				p++;
+			while (*p != ']') {
+				if (!*p)
+					goto none;
+				if (*p == '[' && p[1] && strchr(":.=", p[1])) {
+					/* [:class:], [.coll.], [=equiv=] */
+					char delim = p[1];
+					p += 2;
+					while (p[0] != delim || p[1] != ']') {
+						if (!*p)
+							goto none;
+						p++;
+					}
+					p++;
+				}
+				p++;
+			}
+			continue;
+		}
+		if (ere) {
+			if (c == '|' && depth == 0)
+				goto none;
+			if (c == '(')
+				depth++;
+			if (c == ')' && depth)
+				depth--;
+			if (c == '{') {
+				p = strchr(p, '}');
+				if (!p)
+					goto none;
+			}
+		}
+		if (c == '\\') {
+			c = *++p;
+			if (!c)
+				goto none;
+			if (!ere) {
+				if (c == '|' && depth == 0)
+					goto none;
+				if (c == '(')
+					depth++;
+				if (c == ')' && depth)
+					depth--;
+				if (c == '{') {
+					p = strstr(p, "\\}");
+					if (!p)
+						goto none;
+					p++;
+				}
+			}
+		}
+	}
+	free(cur);
+	if (best_len)
+		return best;
+ none:
+	free(best);
+	return NULL;
+}
+
+static int ac_child(struct fast_match *fm, int s, unsigned char c)
+{
+	int n;
+
+	if (s == 0)
+		return fm->root_next[c];
+	for (n = fm->node[s].child; n; n = fm->node[n].sibling)
+		if (fm->node[n].ch == c)
+			break;
+	return n;
+}
+
+static void ac_add(struct fast_match *fm, const char *needle)
+{
+	int s = 0;
+
+	while (*needle) {
+		unsigned char c = fm->fold[(unsigned char)*needle++];
+		int n;
+
+		for (n = fm->node[s].child; n; n = fm->node[n].sibling)
+			if (fm->node[n].ch == c)
+				break;
+		if (!n) {
+			fm->node = xrealloc_vector(fm->node, 6, fm->node_cnt);
+			n = fm->node_cnt++;
+			fm->node[n].ch = c;
+			fm->node[n].sibling = fm->node[s].child;
+			fm->node[s].child = n;
+		}
+		s = n;
+	}
+	fm->node[s].out = 1;
+}
+
+/* Set failure links, breadth first: parent's link is known before child's */
+static void ac_link(struct fast_match *fm)
+{
+	int *queue;
+	int head, tail, n;
+
+	for (n = fm->node[0].child; n; n = fm->node[n].sibling)
+		fm->root_next[fm->node[n].ch] = n;
+
+	queue = xmalloc(fm->node_cnt * sizeof(queue[0]));
+	head = tail = 0;
+	for (n = fm->node[0].child; n; n = fm->node[n].sibling)
+		queue[tail++] = n; /* .fail = 0 */
+	while (head < tail) {
+		int u = queue[head++];
+
+		for (n = fm->node[u].child; n; n = fm->node[n].sibling) {
+			int f = fm->node[u].fail;
+			unsigned char c = fm->node[n].ch;
+
+			while (f && !ac_child(fm, f, c))
+				f = fm->node[f].fail;
+			f = ac_child(fm, f, c);
+			fm->node[n].fail = f;
+			fm->node[n].out |= fm->node[f].out;
+			queue[tail++] = n;
+		}
+	}
+	free(queue);
+}
+
+/* Returns pointer into a needle in p[len], or NULL */
+static char *fast_search(struct fast_match *fm, char *p, size_t len)
+{
+	char *end;
+	int s;
+
+	if (fm->needle)
+		return memmem(p, len, fm->needle, fm->needle_len);
+
+	end = p + len;
+	s = 0;
+	while (p < end) {
+		unsigned char c = fm->fold[(unsigned char)*p];
+		int n;
+
+		while ((n = ac_child(fm, s, c)) == 0 && s != 0)
+			s = fm->node[s].fail;
+		s = n;
+		if (fm->node[s].out)
+			return p;
+		p++;
+	}
+	return NULL;
+}
+
+static void fast_init(void)
+{
+	struct fast_match *fm;
+	llist_t *cur;
+	char *needle;
+	int i;
+
+	/* Lines without match are printed (or remembered) - can't skip them */
+	if (invert_search)
+		return;
+#if ENABLE_FEATURE_GREP_CONTEXT
+	if (lines_before || lines_after)
+		return;
+#endif
+	fm = xzalloc(sizeof(*fm));
+	for (i = 0; i < 256; i++)
+		fm->fold[i] = (option_mask32 & OPT_i) ? tolower(i) : i;
+	fm->node = xrealloc_vector(fm->node, 6, 0);
+	fm->node_cnt = 1;
+	for (cur = pattern_head; cur; cur = cur->link) {
+		grep_list_data_t *gl = (grep_list_data_t *)cur->data;
+
+		if (FGREP_FLAG) {
+			if (!gl->pattern[0] || strchr(gl->pattern, '\n'))
+				goto fail;
+			needle = xstrdup(gl->pattern);
+		} else {
+			/* Report bad regex even if no line has the needle */
+			compile_pattern(gl);
+			needle = required_literal(gl->pattern, reflags & REG_EXTENDED);
+			if (!needle)
+				goto fail;
+		}
+		if (!pattern_head->link && !(option_mask32 & OPT_i)) {
+			fm->needle = needle;
+			fm->needle_len = strlen(needle);
+			break;
+		}
+		ac_add(fm, needle);
+		free(needle);
+	}
+	ac_link(fm);
+	fm->exact = FGREP_FLAG && !(option_mask32 & (OPT_o|OPT_w|OPT_x));
+	fm->bufsize = 64 * 1024;
+	fm->buf = xmalloc(fm->bufsize);
+	G.fast = fm;
+	return;
+ fail:
+	free(fm->node);
+	free(fm);
+}
+
+static char *find_eol(struct fast_match *fm, char *p, char *end)
+{
+	if (!fm->has_nul)
+		return memchr(p, '\n', end - p);
+	for (; p < end; p++)
+		if (*p == '\n' || *p == '\0')
+			return p;
+	return NULL;
+}
+
+static char *find_last_eol(struct fast_match *fm, char *p, char *end)
+{
+	if (!fm->has_nul)
+		return memrchr(p, '\n', end - p);
+	while (--end >= p)
+		if (*end == '\n' || *end == '\0')
+			return end;
+	return NULL;
+}
+
+static unsigned count_lines(struct fast_match *fm, char *p, char *end)
+{
+	unsigned cnt = 0;
+
+	while ((p = find_eol(fm, p, end)) != NULL) {
+		p++;
+		cnt++;
+	}
+	return cnt;
+}
+
+/* Returns next line which has a needle, without '\n', or NULL on EOF.
+ * Skipped lines are added to *linenum */
+static char *fast_getline(FILE *file, int *linenum)
+{
+	struct fast_match *fm = G.fast;
+
+	for (;;) {
+		char *buf = fm->buf + fm->start;
+		char *end = fm->buf + fm->end;
+		char *p, *nl;
+		ssize_t n;
+
+		p = fast_search(fm, buf, end - buf);
+		if (p) {
+			char *ls = find_last_eol(fm, buf, p);
+			ls = ls ? ls + 1 : buf;
+			*linenum += count_lines(fm, buf, ls);
+			nl = find_eol(fm, p, end);
+			if (nl || fm->eof) {
+				if (!nl)
+					nl = end;
+				fm->start = nl - fm->buf + (nl != end);
+				return xstrndup(ls, nl - ls);
+			}
+			/* Line with a needle isn't read completely yet */
+			fm->start = ls - fm->buf;
+		} else {
+			nl = find_last_eol(fm, buf, end);
+			if (nl) {
+				*linenum += count_lines(fm, buf, nl + 1);
+				fm->start = nl + 1 - fm->buf;
+			}
+		}
+		if (fm->eof)
+			return NULL;
+
+		/* Move incomplete line to the beginning, read more */
+		fm->end -= fm->start;
+		memmove(fm->buf, fm->buf + fm->start, fm->end);
+		fm->start = 0;
+		if (fm->end == fm->bufsize) {
+			fm->bufsize *= 2;
+			fm->buf = xrealloc(fm->buf, fm->bufsize);
+		}
+		/* Not fread: it would wait for full buffer on pipes */
+		n = safe_read(fileno(file), fm->buf + fm->end, fm->bufsize - fm->end);
+		if (n <= 0) {
+			/* Directory is skipped silently, as with getline */
+			if (n < 0 && errno != EISDIR && !SUPPRESS_ERR_MSGS)
+				bb_simple_perror_msg(cur_file);
+			fm->eof = 1;
+		} else {
+			if (memchr(fm->buf + fm->end, '\0', n))
+				fm->has_nul = 1;
+			fm->end += n;
+		}
+	}
+}
+#endif
+
 static int grep_file(FILE *file)
 {
 	smalluint found;
@@ -329,8 +746,18 @@ static int grep_file(FILE *file)
 	enum { print_n_lines_after = 0 };
 #endif
 
+#if ENABLE_FEATURE_GREP_FAST
+	if (G.fast) {
+		G.fast->start = G.fast->end = 0;
+		G.fast->eof = 0;
+		G.fast->has_nul = 0;
+	}
+#endif
+
 	while (
-#if !ENABLE_EXTRA_COMPAT
+#if ENABLE_FEATURE_GREP_FAST
+		(line = G.fast ? fast_getline(file, &linenum) : xmalloc_fgetline(file)) != NULL
+#elif !ENABLE_EXTRA_COMPAT
 		(line = xmalloc_fgetline(file)) != NULL
 #else
 		(line_len = bb_getline(&line, &line_alloc_len, file)) >= 0
@@ -340,6 +767,12 @@ static int grep_file(FILE *file)
 		grep_list_data_t *gl = gl; /* for gcc */
 
 		linenum++;
+#if ENABLE_FEATURE_GREP_FAST
+		if (G.fast && G.fast->exact) {
+			found = 1;
+			goto do_found;
+		}
+#endif
 		found = 0;
 		while (pattern_ptr) {
 			gl = (grep_list_data_t *)pattern_ptr->data;
@@ -380,17 +813,7 @@ static int grep_file(FILE *file)
 #endif
 				char *match_at;
 
-				if (!(gl->flg_mem_allocated_compiled & COMPILED)) {
-					gl->flg_mem_allocated_compiled |= COMPILED;
-#if !ENABLE_EXTRA_COMPAT
-					xregcomp(&gl->compiled_regex, gl->pattern, reflags);
-#else
-					memset(&gl->compiled_regex, 0, sizeof(gl->compiled_regex));
-					gl->compiled_regex.translate = case_fold; /* for -i */
-					if (re_compile_pattern(gl->pattern, strlen(gl->pattern), &gl->compiled_regex))
-						bb_error_msg_and_die("bad regex '%s'", gl->pattern);
-#endif
-				}
+				compile_pattern(gl);
 #if !ENABLE_EXTRA_COMPAT
 				gl->matched_range.rm_so = 0;
 				gl->matched_range.rm_eo = 0;
@@ -663,13 +1086,73 @@ static int FAST_FUNC file_action_grep(const char *filename,
 	return 1;
 }
 
+#if ENABLE_FEATURE_GREP_PARALLEL
+struct file_list {
+	char **names;
+	unsigned cnt;
+};
+
+static int FAST_FUNC file_action_add(const char *filename,
+			struct stat *statbuf UNUSED_PARAM,
+			void* list,
+			int depth UNUSED_PARAM)
+{
+	struct file_list *l = list;
+
+	l->names = xrealloc_vector(l->names, 6, l->cnt);
+	l->names[l->cnt++] = xstrdup(filename);
+	return 1;
+}
+
+/* Runs in a worker process. Returns match count, or -1 on open error */
+static int FAST_FUNC grep_job(unsigned idx, void *list)
+{
+	struct file_list *l = list;
+	int matched = 0;
+
+	if (!file_action_grep(l->names[idx], NULL, &matched, 0))
+		return -1;
+	return matched;
+}
+#endif
+
 static int grep_dir(const char *dir)
 {
 	int matched = 0;
+#if ENABLE_FEATURE_GREP_PARALLEL
+	if (G.nproc > 1) {
+		/* Walk the tree first, then grep the files in workers.
+		 * Output of every file is printed in one piece,
+		 * files appear in the order the walk found them */
+		struct file_list list;
+		int *status;
+		unsigned i;
+
+		list.names = NULL;
+		list.cnt = 0;
+		recursive_action(dir,
+			ACTION_RECURSE | ACTION_FOLLOWLINKS_L0 | ACTION_DEPTHFIRST
+				| ACTION_NO_STAT,
+			file_action_add, NULL, &list, 0);
+		status = xmalloc(list.cnt * sizeof(status[0]));
+		run_parallel_ordered(list.cnt, G.nproc, grep_job, &list, status);
+		for (i = 0; i < list.cnt; i++) {
+			if (status[i] < 0)
+				open_errors = 1;
+			else
+				matched += status[i];
+			free(list.names[i]);
+		}
+		free(list.names);
+		free(status);
+		return matched;
+	}
+#endif
 	recursive_action(dir,
 		/* recurse=yes */ ACTION_RECURSE |
 		/* followLinks=command line only */ ACTION_FOLLOWLINKS_L0 |
-		/* depthFirst=yes */ ACTION_DEPTHFIRST,
+		/* depthFirst=yes */ ACTION_DEPTHFIRST |
+		/* file_action_grep doesn't use statbuf */ ACTION_NO_STAT,
 		/* fileAction= */ file_action_grep,
 		/* dirAction= */ NULL,
 		/* userData= */ &matched,
@@ -687,6 +1170,7 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 	int Copt, opts;
 #endif
 	INIT_G();
+	IF_FEATURE_GREP_PARALLEL(G.nproc = 1;)
 
 	/* For grep, exitcode of 1 is "not found". Other errors are 2: */
 	xfunc_error_retval = 2;
@@ -699,7 +1183,8 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 	opts = getopt32(argv,
 		OPTSTR_GREP,
 		&pattern_head, &fopt, &max_matches,
-		&lines_after, &lines_before, &Copt);
+		&lines_after, &lines_before, &Copt
+		IF_FEATURE_GREP_PARALLEL(, &G.nproc));
 
 	if (opts & OPT_C) {
 		/* -C unsets prev -A and -B, but following -A or -B
@@ -726,9 +1211,22 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 	/* -H unsets -h; -c,-q or -l unset -n; -e,-f are lists; -m N */
 	opt_complementary = "H-h:c-n:q-n:l-n:";
 	getopt32(argv, OPTSTR_GREP,
-		&pattern_head, &fopt, &max_matches);
+		&pattern_head, &fopt, &max_matches
+		IF_FEATURE_GREP_PARALLEL(, &G.nproc));
 #endif
 	invert_search = ((option_mask32 & OPT_v) != 0); /* 0 | 1 */
+#if ENABLE_FEATURE_GREP_PARALLEL
+	if (G.nproc == 0)
+		G.nproc = get_cpu_count();
+	/* -q exits on first match */
+	if (BE_QUIET)
+		G.nproc = 1;
+# if ENABLE_FEATURE_GREP_CONTEXT
+	/* "--" separators depend on what previous files printed */
+	if (lines_before || lines_after)
+		G.nproc = 1;
+# endif
+#endif
 
 	{	/* convert char **argv to grep_list_data_t */
 		llist_t *cur;
@@ -787,6 +1285,9 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 		pattern = new_grep_list_data(*argv++, 0);
 		llist_add_to(&pattern_head, pattern);
 	}
+#if ENABLE_FEATURE_GREP_FAST
+	fast_init();
+#endif
 
 	/* argv[0..(argc-1)] should be names of file to grep through. If
 	 * there is more than one file to grep, we will print the filenames. */
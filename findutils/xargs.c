@@ -60,6 +60,14 @@
 //config:	depends on XARGS
 //config:	help
 //config:	  Support -I STR and -i[STR] options.
+//config:
+//config:config FEATURE_XARGS_SUPPORT_PARALLEL
+//config:	bool "Enable -P N: run up to N commands in parallel"
+//config:	default y
+//config:	depends on XARGS
+//config:	help
+//config:	  Support -P N: run up to N command lines at once
+//config:	  (-P 0: as many as possible).
 
 //applet:IF_XARGS(APPLET_NOEXEC(xargs, xargs, BB_DIR_USR_BIN, BB_SUID_DROP, xargs))
 
@@ -100,6 +108,15 @@ struct globals {
 #endif
 	const char *eof_str;
 	int idx;
+#if ENABLE_FEATURE_XARGS_SUPPORT_PARALLEL
+	int max_procs;   /* 0: run commands one by one */
+	int running;
+	int procs_size;
+	struct xargs_proc {
+		pid_t pid;   /* 0: free slot */
+		char *prog;
+	} *procs;
+#endif
 } FIX_ALIASING;
 #define G (*(struct globals*)bb_common_bufsiz1)
 #define INIT_G() do { \
@@ -107,25 +124,25 @@ struct globals {
 	G.eof_str = NULL; /* need to clear by hand because we are NOEXEC applet */ \
 	IF_FEATURE_XARGS_SUPPORT_REPL_STR(G.repl_str = "{}";) \
 	IF_FEATURE_XARGS_SUPPORT_REPL_STR(G.eol_ch = '\n';) \
+	IF_FEATURE_XARGS_SUPPORT_PARALLEL(G.max_procs = 0;) \
+	IF_FEATURE_XARGS_SUPPORT_PARALLEL(G.running = 0;) \
+	IF_FEATURE_XARGS_SUPPORT_PARALLEL(G.procs_size = 0;) \
+	IF_FEATURE_XARGS_SUPPORT_PARALLEL(G.procs = NULL;) \
 } while (0)
 
 
-static int xargs_exec(void)
+/* Convert wait4pid() result to our exit code:
+ * 123 if command exited with 1..254 (we go on),
+ * 124 if it exited with 255, 125 if it was killed (we stop) */
+static int child_status(const char *prog, int status)
 {
-	int status;
-
-	status = spawn_and_wait(G.args);
-	if (status < 0) {
-		bb_simple_perror_msg(G.args[0]);
-		return errno == ENOENT ? 127 : 126;
-	}
 	if (status == 255) {
-		bb_error_msg("%s: exited with status 255; aborting", G.args[0]);
+		bb_error_msg("%s: exited with status 255; aborting", prog);
 		return 124;
 	}
 	if (status >= 0x180) {
 		bb_error_msg("'%s' terminated by signal %d",
-			G.args[0], status - 0x180);
+			prog, status - 0x180);
 		return 125;
 	}
 	if (status)
@@ -133,6 +150,78 @@ static int xargs_exec(void)
 	return 0;
 }
 
+#if ENABLE_FEATURE_XARGS_SUPPORT_PARALLEL
+/* Wait for any of our children, return its child_status() */
+static int xargs_wait_one(void)
+{
+	int status, i;
+	pid_t pid;
+
+	pid = safe_waitpid(-1, &status, 0);
+	if (pid <= 0) {
+		G.running = 0; /* ECHILD? Should not happen */
+		return 0;
+	}
+	for (i = 0; i < G.procs_size; i++) {
+		if (G.procs[i].pid == pid) {
+			char *prog = G.procs[i].prog;
+
+			G.procs[i].pid = 0;
+			G.running--;
+			status = WIFSIGNALED(status)
+				? WTERMSIG(status) + 0x180
+				: WEXITSTATUS(status);
+			status = child_status(prog, status);
+			free(prog);
+			return status;
+		}
+	}
+	return 0; /* not ours */
+}
+#endif
+
+static int xargs_exec(void)
+{
+	int status;
+
+#if ENABLE_FEATURE_XARGS_SUPPORT_PARALLEL
+	if (G.max_procs) {
+		pid_t pid;
+		int i;
+
+		/* Wait for a free slot */
+		status = 0;
+		if (G.running >= G.max_procs) {
+			status = xargs_wait_one();
+			if (status && status != 123)
+				return status;
+		}
+		pid = spawn(G.args);
+		if (pid < 0) {
+			bb_simple_perror_msg(G.args[0]);
+			return errno == ENOENT ? 127 : 126;
+		}
+		for (i = 0; i < G.procs_size && G.procs[i].pid; i++)
+			continue;
+		if (i == G.procs_size) {
+			/* -P 0 has no limit, grow the table as needed */
+			G.procs = xrealloc_vector(G.procs, 4, i);
+			G.procs_size = (i + 0x10) & ~0xf;
+		}
+		G.procs[i].pid = pid;
+		G.procs[i].prog = xstrdup(G.args[0]);
+		G.running++;
+		return status;
+	}
+#endif
+	status = spawn_and_wait(G.args);
+	if (status < 0) {
+		bb_simple_perror_msg(G.args[0]);
+		return errno == ENOENT ? 127 : 126;
+	}
+	return child_status(G.args[0], status);
+}
+
 /* In POSIX/C locale isspace is only these chars: "\t\n\v\f\r" and space.
  * "\t\n\v\f\r" happen to have ASCII codes 9,10,11,12,13.
  */
@@ -439,6 +528,9 @@ static int xargs_ask_confirmation(void)
 //usage:	IF_FEATURE_XARGS_SUPPORT_TERMOPT(
 //usage:     "\n	-x	Exit if size is exceeded"
 //usage:	)
+//usage:	IF_FEATURE_XARGS_SUPPORT_PARALLEL(
+//usage:     "\n	-P N	Run up to N PROGs at once (0: as many as possible)"
+//usage:	)
 //usage:#define xargs_example_usage
 //usage:       "$ ls | xargs gzip\n"
 //usage:       "$ find . -name '*.c' -print | xargs rm\n"
@@ -456,6 +548,7 @@ enum {
 	IF_FEATURE_XARGS_SUPPORT_ZERO_TERM(   OPTBIT_ZEROTERM   ,)
 	IF_FEATURE_XARGS_SUPPORT_REPL_STR(    OPTBIT_REPLSTR    ,)
 	IF_FEATURE_XARGS_SUPPORT_REPL_STR(    OPTBIT_REPLSTR1   ,)
+	IF_FEATURE_XARGS_SUPPORT_PARALLEL(    OPTBIT_PARALLEL   ,)
 
 	OPT_VERBOSE     = 1 << OPTBIT_VERBOSE    ,
 	OPT_NO_EMPTY    = 1 << OPTBIT_NO_EMPTY   ,
@@ -468,12 +561,14 @@ enum {
 	OPT_ZEROTERM    = IF_FEATURE_XARGS_SUPPORT_ZERO_TERM(   (1 << OPTBIT_ZEROTERM   )) + 0,
 	OPT_REPLSTR     = IF_FEATURE_XARGS_SUPPORT_REPL_STR(    (1 << OPTBIT_REPLSTR    )) + 0,
 	OPT_REPLSTR1    = IF_FEATURE_XARGS_SUPPORT_REPL_STR(    (1 << OPTBIT_REPLSTR1   )) + 0,
+	OPT_PARALLEL    = IF_FEATURE_XARGS_SUPPORT_PARALLEL(    (1 << OPTBIT_PARALLEL   )) + 0,
 };
 #define OPTION_STR "+trn:s:e::E:" \
 	IF_FEATURE_XARGS_SUPPORT_CONFIRMATION("p") \
 	IF_FEATURE_XARGS_SUPPORT_TERMOPT(     "x") \
 	IF_FEATURE_XARGS_SUPPORT_ZERO_TERM(   "0") \
-	IF_FEATURE_XARGS_SUPPORT_REPL_STR(    "I:i::")
+	IF_FEATURE_XARGS_SUPPORT_REPL_STR(    "I:i::") \
+	IF_FEATURE_XARGS_SUPPORT_PARALLEL(    "P:")
 
 int xargs_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int xargs_main(int argc, char **argv)
@@ -482,6 +577,7 @@ int xargs_main(int argc, char **argv)
 	int child_error = 0;
 	char *max_args;
 	char *max_chars;
+	IF_FEATURE_XARGS_SUPPORT_PARALLEL(char *max_procs;)
 	char *buf;
 	unsigned opt;
 	int n_max_chars;
@@ -504,8 +600,19 @@ int xargs_main(int argc, char **argv)
 	opt = getopt32(argv, OPTION_STR,
 		&max_args, &max_chars, &G.eof_str, &G.eof_str
 		IF_FEATURE_XARGS_SUPPORT_REPL_STR(, &G.repl_str, &G.repl_str)
+		IF_FEATURE_XARGS_SUPPORT_PARALLEL(, &max_procs)
 	);
 
+#if ENABLE_FEATURE_XARGS_SUPPORT_PARALLEL
+	if (opt & OPT_PARALLEL) {
+		G.max_procs = xatoi_positive(max_procs);
+		if (G.max_procs == 0) /* -P 0: no limit */
+			G.max_procs = INT_MAX;
+		if (G.max_procs == 1) /* -P 1: same as no -P */
+			G.max_procs = 0;
+	}
+#endif
+
 	/* -E ""? You may wonder why not just omit -E?
 	 * This is used for portability:
 	 * old xargs was using "_" as default for -E / -e */
@@ -628,7 +735,10 @@ int xargs_main(int argc, char **argv)
 		}
 
 		if (!(opt & OPT_INTERACTIVE) || xargs_ask_confirmation()) {
-			child_error = xargs_exec();
+			int status = xargs_exec();
+			/* Once any command failed, exit code stays 123 */
+			if (status)
+				child_error = status;
 		}
 
 		if (child_error > 0 && child_error != 123) {
@@ -638,6 +748,15 @@ int xargs_main(int argc, char **argv)
 		overlapping_strcpy(buf, rem);
 	} /* while */
 
+#if ENABLE_FEATURE_XARGS_SUPPORT_PARALLEL
+	/* Wait for the rest. 124..127 (we had to stop) take precedence */
+	while (G.running) {
+		int status = xargs_wait_one();
+		if (child_error < status)
+			child_error = status;
+	}
+#endif
+
 	if (ENABLE_FEATURE_CLEAN_UP) {
 		free(G.args);
 		free(buf);
@@ -27,4 +27,16 @@ typedef enum bb_suid_t {
 	BB_SUID_REQUIRE
 } bb_suid_t;
 
+/* Hash used for perfect hash of applet names (see applets/applet_tables.c).
+ * Returns a number in [0, n) */
+static inline unsigned bb_applet_hash(const char *name, unsigned seed, unsigned n)
+{
+	unsigned h = 0x811c9dc5u + seed * 0x9e3779b9u;
+	while (*name)
+		h = (h ^ (unsigned char)*name++) * 0x01000193u;
+	h ^= h >> 15;
+	/* Same as h % n, but without division */
+	return ((unsigned long long)h * n) >> 32;
+}
+
 #endif
@@ -383,6 +383,8 @@ enum {	/* cp.c, mv.c, install.c depend on these values. CAREFUL when changing th
 	 * Hole. cp may have some bits set here,
 	 * they should not affect remove_file()/copy_file()
 	 */
+	/* copy_file(): only remember regular files, see copy_file_deferred() */
+	FILEUTILS_PARALLEL        = (1 << 29) * ENABLE_FEATURE_CP_PARALLEL,
 #if ENABLE_SELINUX
 	FILEUTILS_SET_SECURITY_CONTEXT = 1 << 30,
 #endif
@@ -395,6 +397,9 @@ extern int remove_file(const char *path, int flags) FAST_FUNC;
  * This makes "cp /dev/null file" and "install /dev/null file" (!!!)
  * work coreutils-compatibly. */
 extern int copy_file(const char *source, const char *dest, int flags) FAST_FUNC;
+/* Copy files remembered by copy_file(FILEUTILS_PARALLEL) in nproc processes,
+ * then set modes/times of directories. -1 if any copy failed */
+extern int copy_file_deferred(unsigned nproc) FAST_FUNC;
 
 enum {
 	ACTION_RECURSE        = (1 << 0),
@@ -404,6 +409,7 @@ enum {
 	/*ACTION_REVERSE      = (1 << 4), - unused */
 	ACTION_QUIET          = (1 << 5),
 	ACTION_DANGLING_OK    = (1 << 6),
+	ACTION_NO_STAT        = (1 << 7), /* fileAction needs only S_IFMT bits */
 };
 typedef uint8_t recurse_flags_t;
 extern int recursive_action(const char *fileName, unsigned flags,
@@ -420,6 +426,8 @@ extern char *find_block_device(const char *path) FAST_FUNC;
 extern off_t bb_copyfd_eof(int fd1, int fd2) FAST_FUNC;
 extern off_t bb_copyfd_size(int fd1, int fd2, off_t size) FAST_FUNC;
 extern void bb_copyfd_exact_size(int fd1, int fd2, off_t size) FAST_FUNC;
+/* Copies regular file to a new empty one. st: its stat, used as a hint */
+extern off_t bb_copyfd_file(int fd1, int fd2, const struct stat *st) FAST_FUNC;
 /* "short" copy can be detected by return value < size */
 /* this helper yells "short read!" if param is not -1 */
 extern void complain_copyfd_and_die(off_t sz) NORETURN FAST_FUNC;
@@ -1048,6 +1056,16 @@ int wait_for_exitstatus(pid_t pid) FAST_FUNC;
 int spawn_and_wait(char **argv) FAST_FUNC;
 /* Does NOT check that applet is NOFORK, just blindly runs it */
 int run_nofork_applet(int applet_no, char **argv) FAST_FUNC;
+#if BB_MMU
+/* Run job(0..njobs-1) in nproc forked workers (nproc < 2: serially).
+ * Stdout of jobs appears in job order, as if they were run serially.
+ * Return values of jobs are stored in status[] (can be NULL).
+ * If a job dies, dies too after all workers are gone.
+ */
+void run_parallel_ordered(unsigned njobs, unsigned nproc,
+		int FAST_FUNC (*job)(unsigned idx, void *arg), void *arg,
+		int *status) FAST_FUNC;
+#endif
 
 /* Helpers for daemonization.
  *
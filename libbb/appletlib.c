@@ -138,6 +138,18 @@ void FAST_FUNC bb_show_usage(void)
 	xfunc_die();
 }
 
+#ifdef APPLET_HASH_BUCKETS
+/* applet_tables generator has found a perfect hash for applet names */
+int FAST_FUNC find_applet_by_name(const char *name)
+{
+	unsigned d = applet_hash_disp[bb_applet_hash(name, 0, APPLET_HASH_BUCKETS)];
+	unsigned i = applet_hash_no[bb_applet_hash(name, d, NUM_APPLETS)];
+
+	if (strcmp(name, applet_names + applet_name_ofs[i]) != 0)
+		return -1;
+	return i;
+}
+#else
 int FAST_FUNC find_applet_by_name(const char *name)
 {
 	unsigned i, max;
@@ -264,6 +276,48 @@ int FAST_FUNC find_applet_by_name(const char *name)
 	return -1;
 #endif
 }
+#endif /* !APPLET_HASH_BUCKETS */
+
+#if ENABLE_UNIT_TEST
+
+static const char *nth_applet_name(int n)
+{
+	const char *a = applet_names;
+	while (--n >= 0)
+		a += strlen(a) + 1;
+	return a;
+}
+
+BBUNIT_DEFINE_TEST(find_applet_by_name)
+{
+	const char *a = applet_names;
+	char name[64];
+	int i = 0;
+
+	while (*a) {
+		int r;
+
+		BBUNIT_ASSERT_EQ(i, find_applet_by_name(a));
+		/* "name" + "x" and "nam" are applets only if they have these names */
+		strcpy(name, a);
+		strcat(name, "x");
+		r = find_applet_by_name(name);
+		if (r >= 0)
+			BBUNIT_ASSERT_STREQ(nth_applet_name(r), name);
+		name[strlen(a) - 1] = '\0';
+		r = find_applet_by_name(name);
+		if (r >= 0)
+			BBUNIT_ASSERT_STREQ(nth_applet_name(r), name);
+		a += strlen(a) + 1;
+		i++;
+	}
+	BBUNIT_ASSERT_EQ(-1, find_applet_by_name(""));
+	BBUNIT_ASSERT_EQ(-1, find_applet_by_name("no such applet"));
+
+	BBUNIT_ENDTEST;
+}
+
+#endif /* ENABLE_UNIT_TEST */
 
 
 void lbb_prepare(const char *applet
@@ -573,6 +627,8 @@ static void check_suid(int applet_no)
 {
 	gid_t rgid;  /* real gid */
 
+	/* Not in main(): "busybox --list" etc don't need it */
+	parse_config_file(); /* ...maybe, if FEATURE_SUID_CONFIG */
 	if (ruid == 0) /* set by parse_config_file() */
 		return; /* run by root - no need to check more */
 	rgid = getgid();
@@ -841,6 +897,27 @@ static int busybox_main(char **argv)
 }
 # endif
 
+# if ENABLE_FEATURE_STARTUP_TRACE
+/* monotonic_us() at main(), 0 if not tracing */
+static unsigned long long startup_trace_us;
+/* CPU time used before main() (exec, dynamic linking, libc init) */
+static unsigned startup_pre_main_us;
+
+static void report_startup_time(void)
+{
+	unsigned us = monotonic_us() - startup_trace_us;
+
+	/* Do not report again in children of e.g. a shell */
+	startup_trace_us = 0;
+	full_write2_str(applet_name);
+	full_write2_str(": startup: ");
+	full_write2_str(utoa(startup_pre_main_us));
+	full_write2_str(" us CPU before main, ");
+	full_write2_str(utoa(us));
+	full_write2_str(" us from main to applet\n");
+}
+# endif
+
 # if NUM_APPLETS > 0
 void FAST_FUNC run_applet_no_and_exit(int applet_no, char **argv)
 {
@@ -877,6 +954,10 @@ void FAST_FUNC run_applet_no_and_exit(int applet_no, char **argv)
 	}
 	if (ENABLE_FEATURE_SUID)
 		check_suid(applet_no);
+#  if ENABLE_FEATURE_STARTUP_TRACE
+	if (startup_trace_us)
+		report_startup_time();
+#  endif
 	xfunc_error_retval = applet_main[applet_no](argc, argv);
 	/* Note: applet_main() may also not return (die on a xfunc or such) */
 	xfunc_die();
@@ -915,6 +996,14 @@ int lbb_main(char **argv)
 int main(int argc UNUSED_PARAM, char **argv)
 #endif
 {
+#if ENABLE_FEATURE_STARTUP_TRACE && !defined(SINGLE_APPLET_MAIN)
+	if (getenv("BB_TRACE_STARTUP")) {
+		struct timespec ts;
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+		startup_pre_main_us = ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+		startup_trace_us = monotonic_us();
+	}
+#endif
 #if 0
 	/* TODO: find a use for a block of memory between end of .bss
 	 * and end of page. For example, I'm getting "_end:0x812e698 2408 bytes"
@@ -980,8 +1069,6 @@ int main(int argc UNUSED_PARAM, char **argv)
 		applet_name++;
 	applet_name = bb_basename(applet_name);
 
-	parse_config_file(); /* ...maybe, if FEATURE_SUID_CONFIG */
-
 	run_applet_and_exit(applet_name, argv);
 #endif
 }
@@ -20,6 +20,85 @@
 // This is strange, but POSIX-correct.
 // coreutils cp has --remove-destination to override this...
 
+static void preserve_status(const char *dest, struct stat *source_stat)
+{
+	struct timeval times[2];
+
+	times[1].tv_sec = times[0].tv_sec = source_stat->st_mtime;
+	times[1].tv_usec = times[0].tv_usec = 0;
+	/* BTW, utimes sets usec-precision time - just FYI */
+	if (utimes(dest, times) < 0)
+		bb_perror_msg("can't preserve %s of '%s'", "times", dest);
+	if (chown(dest, source_stat->st_uid, source_stat->st_gid) < 0) {
+		source_stat->st_mode &= ~(S_ISUID | S_ISGID);
+		bb_perror_msg("can't preserve %s of '%s'", "ownership", dest);
+	}
+	if (chmod(dest, source_stat->st_mode) < 0)
+		bb_perror_msg("can't preserve %s of '%s'", "permissions", dest);
+}
+
+#if ENABLE_FEATURE_CP_PARALLEL
+/* With FILEUTILS_PARALLEL, copy_file() only creates directories
+ * (and links, special files...) and remembers which regular files
+ * to copy. copy_file_deferred() then copies them in worker processes,
+ * and only after that fixes modes and times of the directories,
+ * children first - as copy_file() without FILEUTILS_PARALLEL would.
+ */
+struct deferred_file {
+	char *source, *dest;
+	int flags;
+};
+struct deferred_dir {
+	char *dest;
+	struct stat source_stat;
+	int flags;
+	int chmod_mode; /* -1: don't chmod */
+};
+static struct deferred {
+	struct deferred_file *file;
+	struct deferred_dir *dir;
+	unsigned nfiles, ndirs;
+} deferred;
+
+static int FAST_FUNC copy_deferred_file(unsigned idx, void *arg UNUSED_PARAM)
+{
+	struct deferred_file *f = &deferred.file[idx];
+	return copy_file(f->source, f->dest, f->flags);
+}
+
+int FAST_FUNC copy_file_deferred(unsigned nproc)
+{
+	int *status;
+	unsigned i;
+	int retval = 0;
+
+	status = xmalloc(deferred.nfiles * sizeof(status[0]) + 1);
+	run_parallel_ordered(deferred.nfiles, nproc, copy_deferred_file, NULL, status);
+	for (i = 0; i < deferred.nfiles; i++) {
+		if (status[i] < 0)
+			retval = -1;
+		free(deferred.file[i].source);
+		free(deferred.file[i].dest);
+	}
+	free(status);
+
+	for (i = 0; i < deferred.ndirs; i++) {
+		struct deferred_dir *d = &deferred.dir[i];
+
+		if (d->chmod_mode != -1 && chmod(d->dest, d->chmod_mode) < 0)
+			bb_perror_msg("can't preserve %s of '%s'", "permissions", d->dest);
+		if (d->flags & FILEUTILS_PRESERVE_STATUS)
+			preserve_status(d->dest, &d->source_stat);
+		free(d->dest);
+	}
+
+	free(deferred.file);
+	free(deferred.dir);
+	memset(&deferred, 0, sizeof(deferred));
+	return retval;
+}
+#endif
+
 /* Called if open of destination, link creation etc fails.
  * errno must be set to relevant value ("why we cannot create dest?")
  * to give reasonable error message */
@@ -99,6 +178,24 @@ int FAST_FUNC copy_file(const char *source, const char *dest, int flags)
 		return -1;
 	}
 
+#if ENABLE_FEATURE_CP_PARALLEL
+	if ((flags & FILEUTILS_PARALLEL)
+	 && S_ISREG(source_stat.st_mode)
+	 && !(flags & (FILEUTILS_MAKE_SOFTLINK|FILEUTILS_MAKE_HARDLINK))
+	 /* Other links to it must be link()ed to an existing file */
+	 && (source_stat.st_nlink == 1 || !ENABLE_FEATURE_PRESERVE_HARDLINKS || FLAGS_DEREF)
+	) {
+		struct deferred_file *f;
+
+		deferred.file = xrealloc_vector(deferred.file, 8, deferred.nfiles);
+		f = &deferred.file[deferred.nfiles++];
+		f->source = xstrdup(source);
+		f->dest = xstrdup(dest);
+		f->flags = flags & ~FILEUTILS_PARALLEL;
+		return 0;
+	}
+#endif
+
 	if (lstat(dest, &dest_stat) < 0) {
 		if (errno != ENOENT) {
 			bb_perror_msg("can't stat '%s'", dest);
@@ -206,6 +303,20 @@ int FAST_FUNC copy_file(const char *source, const char *dest, int flags)
 		}
 		closedir(dp);
 
+#if ENABLE_FEATURE_CP_PARALLEL
+		if (flags & FILEUTILS_PARALLEL) {
+			/* Files in it are not copied yet */
+			struct deferred_dir *dd;
+
+			deferred.dir = xrealloc_vector(deferred.dir, 6, deferred.ndirs);
+			dd = &deferred.dir[deferred.ndirs++];
+			dd->dest = xstrdup(dest);
+			dd->source_stat = source_stat;
+			dd->flags = flags;
+			dd->chmod_mode = dest_exists ? -1 : (int)(source_stat.st_mode & ~saved_umask);
+			return retval;
+		}
+#endif
 		if (!dest_exists
 		 && chmod(dest, source_stat.st_mode & ~saved_umask) < 0
 		) {
@@ -340,7 +451,7 @@ int FAST_FUNC copy_file(const char *source, const char *dest, int flags)
 			}
 		}
 #endif
-		if (bb_copyfd_eof(src_fd, dst_fd) == -1)
+		if (bb_copyfd_file(src_fd, dst_fd, &source_stat) == -1)
 			retval = -1;
 		/* Careful with writing... */
 		if (close(dst_fd) < 0) {
@@ -400,19 +511,7 @@ int FAST_FUNC copy_file(const char *source, const char *dest, int flags)
 	/* Cannot happen: */
 	/* && !(flags & (FILEUTILS_MAKE_SOFTLINK|FILEUTILS_MAKE_HARDLINK)) */
 	) {
-		struct timeval times[2];
-
-		times[1].tv_sec = times[0].tv_sec = source_stat.st_mtime;
-		times[1].tv_usec = times[0].tv_usec = 0;
-		/* BTW, utimes sets usec-precision time - just FYI */
-		if (utimes(dest, times) < 0)
-			bb_perror_msg("can't preserve %s of '%s'", "times", dest);
-		if (chown(dest, source_stat.st_uid, source_stat.st_gid) < 0) {
-			source_stat.st_mode &= ~(S_ISUID | S_ISGID);
-			bb_perror_msg("can't preserve %s of '%s'", "ownership", dest);
-		}
-		if (chmod(dest, source_stat.st_mode) < 0)
-			bb_perror_msg("can't preserve %s of '%s'", "permissions", dest);
+		preserve_status(dest, &source_stat);
 	}
 
  verb_and_exit:
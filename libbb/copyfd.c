@@ -13,6 +13,21 @@
 #else
 # define sendfile(a,b,c,d) (-1)
 #endif
+#if ENABLE_FEATURE_USE_COPY_FILE_RANGE
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+/* <linux/fs.h> does not mix well with libc headers */
+# ifndef FICLONE
+#  define FICLONE _IOW(0x94, 9, int)
+# endif
+# if defined(__NR_copy_file_range)
+/* (not calling libc's: older ones don't have it) */
+#  define copy_file_range(in, out, len) \
+	syscall(__NR_copy_file_range, (in), NULL, (out), NULL, (size_t)(len), 0)
+# else
+#  define copy_file_range(in, out, len) ((errno = ENOSYS), -1)
+# endif
+#endif
 
 /*
  * We were using 0x7fff0000 as sendfile chunk size, but it
@@ -158,3 +173,111 @@ off_t FAST_FUNC bb_copyfd_eof(int fd1, int fd2)
 {
 	return bb_full_fd_action(fd1, fd2, 0);
 }
+
+#if ENABLE_FEATURE_USE_COPY_FILE_RANGE
+/* Copy up to len bytes from current file positions, in kernel if it can.
+ * Returns number of bytes copied (< len if eof), or -1.
+ */
+static off_t copy_range(int src_fd, int dst_fd, off_t len, smallint *use_cfr)
+{
+	off_t total = 0;
+
+	while (total < len) {
+		ssize_t rd;
+
+		if (*use_cfr) {
+			off_t chunk = len - total;
+			if (chunk > SENDFILE_BIGBUF)
+				chunk = SENDFILE_BIGBUF;
+			rd = copy_file_range(src_fd, dst_fd, chunk);
+			if (rd > 0) {
+				total += rd;
+				continue;
+			}
+			if (rd == 0 && total != 0) /* eof */
+				break;
+			/* EXDEV, ENOSYS, or some fs just returns 0: do it ourself.
+			 * If it is a real I/O error, fallback code will complain */
+			*use_cfr = 0;
+		}
+		rd = bb_full_fd_action(src_fd, dst_fd, len - total);
+		if (rd < 0)
+			return rd;
+		total += rd;
+		break;
+	}
+	return total;
+}
+#endif
+
+/* Copy a regular file, which has just been fstat'ed, to an empty one.
+ * Clone it or copy it in kernel if possible, and don't fill the holes.
+ * Then continue till eof, as file might have grown meanwhile
+ * (or it is in /proc and its st_size means nothing).
+ */
+off_t FAST_FUNC bb_copyfd_file(int src_fd, int dst_fd,
+		const struct stat *st IF_NOT_FEATURE_USE_COPY_FILE_RANGE(UNUSED_PARAM))
+{
+#if ENABLE_FEATURE_USE_COPY_FILE_RANGE
+	smallint use_cfr = 1;
+	off_t pos, rd;
+
+	if (!S_ISREG(st->st_mode))
+		return bb_copyfd_eof(src_fd, dst_fd);
+
+	if (ioctl(dst_fd, FICLONE, src_fd) == 0)
+		return lseek(dst_fd, 0, SEEK_END);
+
+	pos = 0;
+	if ((off_t)st->st_blocks * 512 < st->st_size) {
+		/* Has holes (or is compressed). Copy only data regions */
+		for (;;) {
+			off_t data, hole;
+
+			data = lseek(src_fd, pos, SEEK_DATA);
+			if (data < 0) {
+				if (errno == ENXIO) {
+					/* Only a hole till eof. Make it in dst too */
+					data = lseek(src_fd, 0, SEEK_END);
+					if (data > pos) {
+						if (ftruncate(dst_fd, data) < 0) {
+							bb_perror_msg(bb_msg_write_error);
+							return -1;
+						}
+						pos = data;
+					}
+				}
+				/* else: fs can't tell us where holes are */
+				break;
+			}
+			hole = lseek(src_fd, data, SEEK_HOLE);
+			if (hole < 0
+			 || lseek(src_fd, data, SEEK_SET) < 0
+			 || lseek(dst_fd, data, SEEK_SET) < 0
+			) {
+				break;
+			}
+			rd = copy_range(src_fd, dst_fd, hole - data, &use_cfr);
+			if (rd < 0)
+				return rd;
+			pos = data + rd;
+			if (rd < hole - data) /* file has shrunk? */
+				break;
+		}
+		if (lseek(src_fd, pos, SEEK_SET) < 0 || lseek(dst_fd, pos, SEEK_SET) < 0)
+			return bb_copyfd_eof(src_fd, dst_fd); /* can't be, but... */
+	}
+	if (st->st_size > pos) {
+		rd = copy_range(src_fd, dst_fd, st->st_size - pos, &use_cfr);
+		if (rd < 0)
+			return rd;
+		pos += rd;
+	}
+	rd = bb_copyfd_eof(src_fd, dst_fd);
+	if (rd < 0)
+		return rd;
+	return pos + rd;
+#else
+	return bb_copyfd_eof(src_fd, dst_fd);
+#endif
+}
@@ -559,6 +559,114 @@ static void FAST_FUNC sha1_process_block64(sha1_ctx_t *ctx)
 	ctx->hash[4] += e;
 }
 
+#if (ENABLE_SHA1_HWACCEL || ENABLE_SHA256_HWACCEL) \
+ && defined(__x86_64__) && __GNUC_PREREQ(5,0)
+# include <cpuid.h>
+# include <immintrin.h>
+# define SHA_NI 1
+/* x86 SHA extensions. Need SSSE3 and SSE4.1 too,
+ * every CPU with SHA-NI has them. Without SHA-NI,
+ * SSSE3 still helps to compute sha256 message schedule.
+ */
+enum { CPU_SHA_GENERIC = 1, CPU_SHA_SSSE3, CPU_SHA_NI };
+static smallint cpu_sha; /* 0: not checked yet, else one of the above */
+
+static int x86_sha_level(void)
+{
+	if (!cpu_sha) {
+		unsigned eax, ebx, ecx, edx;
+		cpu_sha = CPU_SHA_GENERIC;
+		if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3)) {
+			cpu_sha = CPU_SHA_SSSE3;
+			if ((ecx & bit_SSE4_1) && __get_cpuid_max(0, NULL) >= 7) {
+				__cpuid_count(7, 0, eax, ebx, ecx, edx);
+				if (ebx & (1 << 29))
+					cpu_sha = CPU_SHA_NI;
+			}
+		}
+	}
+	return cpu_sha;
+}
+#endif
+
+#if ENABLE_SHA1_HWACCEL && defined(SHA_NI)
+static void FAST_FUNC __attribute__((target("sha,ssse3,sse4.1")))
+sha1_process_block64_shaNI(sha1_ctx_t *ctx)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	const __m128i *data = (const __m128i *)ctx->wbuffer;
+	__m128i abcd, abcd_save, e0, e0_save, e1;
+	__m128i m0, m1, m2, m3;
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)ctx->hash), 0x1b);
+	e0 = _mm_set_epi32(ctx->hash[4], 0, 0, 0);
+	abcd_save = abcd;
+	e0_save = e0;
+
+	/* Rounds 0-15 use message words as is, and start the schedule */
+	m0 = _mm_shuffle_epi8(_mm_loadu_si128(data + 0), bswap);
+	e0 = _mm_add_epi32(e0, m0);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+	m1 = _mm_shuffle_epi8(_mm_loadu_si128(data + 1), bswap);
+	e1 = _mm_sha1nexte_epu32(e1, m1);
+	e0 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+	m0 = _mm_sha1msg1_epu32(m0, m1);
+
+	m2 = _mm_shuffle_epi8(_mm_loadu_si128(data + 2), bswap);
+	e0 = _mm_sha1nexte_epu32(e0, m2);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+	m1 = _mm_sha1msg1_epu32(m1, m2);
+	m0 = _mm_xor_si128(m0, m2);
+
+	m3 = _mm_shuffle_epi8(_mm_loadu_si128(data + 3), bswap);
+	e1 = _mm_sha1nexte_epu32(e1, m3);
+	e0 = abcd;
+	m0 = _mm_sha1msg2_epu32(m0, m3);
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+	m2 = _mm_sha1msg1_epu32(m2, m3);
+	m1 = _mm_xor_si128(m1, m3);
+
+	/* Rounds 16-79: four rounds per step, computing message words
+	 * for later steps as we go (the last few are computed
+	 * needlessly, but that is cheaper than special-casing)
+	 */
+#define ROUNDS4(ecur, enext, mcur, mnext, mnext2, mprev, func) do { \
+	ecur = _mm_sha1nexte_epu32(ecur, mcur); \
+	enext = abcd; \
+	mnext = _mm_sha1msg2_epu32(mnext, mcur); \
+	abcd = _mm_sha1rnds4_epu32(abcd, ecur, func); \
+	mprev = _mm_sha1msg1_epu32(mprev, mcur); \
+	mnext2 = _mm_xor_si128(mnext2, mcur); \
+} while (0)
+	ROUNDS4(e0, e1, m0, m1, m2, m3, 0);
+	ROUNDS4(e1, e0, m1, m2, m3, m0, 1);
+	ROUNDS4(e0, e1, m2, m3, m0, m1, 1);
+	ROUNDS4(e1, e0, m3, m0, m1, m2, 1);
+	ROUNDS4(e0, e1, m0, m1, m2, m3, 1);
+	ROUNDS4(e1, e0, m1, m2, m3, m0, 1);
+	ROUNDS4(e0, e1, m2, m3, m0, m1, 2);
+	ROUNDS4(e1, e0, m3, m0, m1, m2, 2);
+	ROUNDS4(e0, e1, m0, m1, m2, m3, 2);
+	ROUNDS4(e1, e0, m1, m2, m3, m0, 2);
+	ROUNDS4(e0, e1, m2, m3, m0, m1, 2);
+	ROUNDS4(e1, e0, m3, m0, m1, m2, 3);
+	ROUNDS4(e0, e1, m0, m1, m2, m3, 3);
+	ROUNDS4(e1, e0, m1, m2, m3, m0, 3);
+	ROUNDS4(e0, e1, m2, m3, m0, m1, 3);
+	ROUNDS4(e1, e0, m3, m0, m1, m2, 3);
+#undef ROUNDS4
+
+	e0 = _mm_sha1nexte_epu32(e0, e0_save);
+	abcd = _mm_add_epi32(abcd, abcd_save);
+	_mm_storeu_si128((__m128i *)ctx->hash, _mm_shuffle_epi32(abcd, 0x1b));
+	ctx->hash[4] = _mm_extract_epi32(e0, 3);
+}
+#endif
+
 /* Constants for SHA512 from FIPS 180-2:4.2.3.
  * SHA256 constants from FIPS 180-2:4.2.2
  * are the most significant half of first 64 elements
@@ -679,6 +787,160 @@ static void FAST_FUNC sha256_process_block64(sha256_ctx_t *ctx)
 	ctx->hash[7] += h;
 }
 
+#if ENABLE_SHA256_HWACCEL && defined(SHA_NI)
+static void FAST_FUNC __attribute__((target("sha,ssse3,sse4.1")))
+sha256_process_block64_shaNI(sha256_ctx_t *ctx)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	const __m128i *data = (const __m128i *)ctx->wbuffer;
+	__m128i state0, state1, abef_save, cdgh_save;
+	__m128i msg, tmp, m0, m1, m2, m3;
+
+	/* Hash is kept as ABEF and CDGH by the instructions */
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&ctx->hash[0]), 0xb1);
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&ctx->hash[4]), 0x1b);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+	abef_save = state0;
+	cdgh_save = state1;
+
+	m0 = _mm_shuffle_epi8(_mm_loadu_si128(data + 0), bswap);
+	m1 = _mm_shuffle_epi8(_mm_loadu_si128(data + 1), bswap);
+	m2 = _mm_shuffle_epi8(_mm_loadu_si128(data + 2), bswap);
+	m3 = _mm_shuffle_epi8(_mm_loadu_si128(data + 3), bswap);
+
+/* sha_K[] has 64-bit sha512 constants, sha256 ones are upper halves */
+#define K4(t) _mm_castps_si128(_mm_shuffle_ps( \
+	_mm_loadu_ps((const float *)&sha_K[t]), \
+	_mm_loadu_ps((const float *)&sha_K[t + 2]), \
+	_MM_SHUFFLE(3, 1, 3, 1)))
+#define ROUNDS4(t, mcur) do { \
+	msg = _mm_add_epi32(mcur, K4(t)); \
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+	state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e)); \
+} while (0)
+/* Four rounds, plus message words mnext for 16 rounds later */
+#define ROUNDS4_SCHED(t, mcur, mnext, mprev) do { \
+	msg = _mm_add_epi32(mcur, K4(t)); \
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+	tmp = _mm_alignr_epi8(mcur, mprev, 4); \
+	mnext = _mm_sha256msg2_epu32(_mm_add_epi32(mnext, tmp), mcur); \
+	state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e)); \
+	mprev = _mm_sha256msg1_epu32(mprev, mcur); \
+} while (0)
+	ROUNDS4(0, m0);
+	ROUNDS4(4, m1);
+	m0 = _mm_sha256msg1_epu32(m0, m1);
+	ROUNDS4(8, m2);
+	m1 = _mm_sha256msg1_epu32(m1, m2);
+	ROUNDS4_SCHED(12, m3, m0, m2);
+	ROUNDS4_SCHED(16, m0, m1, m3);
+	ROUNDS4_SCHED(20, m1, m2, m0);
+	ROUNDS4_SCHED(24, m2, m3, m1);
+	ROUNDS4_SCHED(28, m3, m0, m2);
+	ROUNDS4_SCHED(32, m0, m1, m3);
+	ROUNDS4_SCHED(36, m1, m2, m0);
+	ROUNDS4_SCHED(40, m2, m3, m1);
+	ROUNDS4_SCHED(44, m3, m0, m2);
+	ROUNDS4_SCHED(48, m0, m1, m3);
+	ROUNDS4_SCHED(52, m1, m2, m0);
+	ROUNDS4_SCHED(56, m2, m3, m1);
+	ROUNDS4(60, m3);
+#undef ROUNDS4_SCHED
+#undef ROUNDS4
+#undef K4
+
+	state0 = _mm_add_epi32(state0, abef_save);
+	state1 = _mm_add_epi32(state1, cdgh_save);
+	tmp = _mm_shuffle_epi32(state0, 0x1b);
+	state1 = _mm_shuffle_epi32(state1, 0xb1);
+	_mm_storeu_si128((__m128i *)&ctx->hash[0], _mm_blend_epi16(tmp, state1, 0xf0));
+	_mm_storeu_si128((__m128i *)&ctx->hash[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+/* No SHA-NI: compute message schedule (plus round constants)
+ * four words at a time in SSE registers, rounds are done as usual.
+ */
+static void FAST_FUNC __attribute__((target("ssse3")))
+sha256_process_block64_ssse3(sha256_ctx_t *ctx)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	const __m128i *data = (const __m128i *)ctx->wbuffer;
+	uint32_t WK[64] ALIGNED(16);
+	uint32_t a, b, c, d, e, f, g, h;
+	__m128i x0, x1, x2, x3;
+	unsigned t;
+
+#define K4(t) _mm_castps_si128(_mm_shuffle_ps( \
+	_mm_loadu_ps((const float *)&sha_K[t]), \
+	_mm_loadu_ps((const float *)&sha_K[t + 2]), \
+	_MM_SHUFFLE(3, 1, 3, 1)))
+#define ROR(x, n) _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n))
+	x0 = _mm_shuffle_epi8(_mm_loadu_si128(data + 0), bswap);
+	x1 = _mm_shuffle_epi8(_mm_loadu_si128(data + 1), bswap);
+	x2 = _mm_shuffle_epi8(_mm_loadu_si128(data + 2), bswap);
+	x3 = _mm_shuffle_epi8(_mm_loadu_si128(data + 3), bswap);
+	_mm_store_si128((__m128i *)&WK[0], _mm_add_epi32(x0, K4(0)));
+	_mm_store_si128((__m128i *)&WK[4], _mm_add_epi32(x1, K4(4)));
+	_mm_store_si128((__m128i *)&WK[8], _mm_add_epi32(x2, K4(8)));
+	_mm_store_si128((__m128i *)&WK[12], _mm_add_epi32(x3, K4(12)));
+	for (t = 16; t < 64; t += 4) {
+		__m128i w15 = _mm_alignr_epi8(x1, x0, 4);
+		__m128i w7 = _mm_alignr_epi8(x3, x2, 4);
+		__m128i w2, s;
+
+		s = _mm_xor_si128(_mm_xor_si128(ROR(w15, 7), ROR(w15, 18)), _mm_srli_epi32(w15, 3));
+		x0 = _mm_add_epi32(_mm_add_epi32(x0, w7), s);
+		/* R1 of W[t-2], W[t-1] gives W[t], W[t+1], which give W[t+2], W[t+3] */
+		w2 = _mm_srli_si128(x3, 8);
+		s = _mm_xor_si128(_mm_xor_si128(ROR(w2, 17), ROR(w2, 19)), _mm_srli_epi32(w2, 10));
+		x0 = _mm_add_epi32(x0, s);
+		w2 = _mm_slli_si128(x0, 8);
+		s = _mm_xor_si128(_mm_xor_si128(ROR(w2, 17), ROR(w2, 19)), _mm_srli_epi32(w2, 10));
+		x0 = _mm_add_epi32(x0, s);
+		_mm_store_si128((__m128i *)&WK[t], _mm_add_epi32(x0, K4(t)));
+		s = x0;
+		x0 = x1;
+		x1 = x2;
+		x2 = x3;
+		x3 = s;
+	}
+#undef ROR
+#undef K4
+
+	a = ctx->hash[0];
+	b = ctx->hash[1];
+	c = ctx->hash[2];
+	d = ctx->hash[3];
+	e = ctx->hash[4];
+	f = ctx->hash[5];
+	g = ctx->hash[6];
+	h = ctx->hash[7];
+	for (t = 0; t < 64; ++t) {
+		uint32_t T1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25))
+			+ ((e & f) ^ (~e & g)) + WK[t];
+		uint32_t T2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22))
+			+ ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + T1;
+		d = c;
+		c = b;
+		b = a;
+		a = T1 + T2;
+	}
+	ctx->hash[0] += a;
+	ctx->hash[1] += b;
+	ctx->hash[2] += c;
+	ctx->hash[3] += d;
+	ctx->hash[4] += e;
+	ctx->hash[5] += f;
+	ctx->hash[6] += g;
+	ctx->hash[7] += h;
+}
+#endif
+
 static void FAST_FUNC sha512_process_block128(sha512_ctx_t *ctx)
 {
 	unsigned t;
@@ -751,6 +1013,10 @@ void FAST_FUNC sha1_begin(sha1_ctx_t *ctx)
 	ctx->hash[4] = 0xc3d2e1f0;
 	ctx->total64 = 0;
 	ctx->process_block = sha1_process_block64;
+#if ENABLE_SHA1_HWACCEL && defined(SHA_NI)
+	if (x86_sha_level() == CPU_SHA_NI)
+		ctx->process_block = sha1_process_block64_shaNI;
+#endif
 }
 
 static const uint32_t init256[] = {
@@ -785,6 +1051,12 @@ void FAST_FUNC sha256_begin(sha256_ctx_t *ctx)
 	memcpy(&ctx->total64, init256, sizeof(init256));
 	/*ctx->total64 = 0; - done by prepending two 32-bit zeros to init256 */
 	ctx->process_block = sha256_process_block64;
+#if ENABLE_SHA256_HWACCEL && defined(SHA_NI)
+	if (x86_sha_level() == CPU_SHA_NI)
+		ctx->process_block = sha256_process_block64_shaNI;
+	else if (x86_sha_level() == CPU_SHA_SSSE3)
+		ctx->process_block = sha256_process_block64_ssse3;
+#endif
 }
 
 /* Initialize structure containing state of computation.
@@ -854,7 +1126,14 @@ void FAST_FUNC sha1_end(sha1_ctx_t *ctx, void *resbuf)
 	/* SHA stores total in BE, need to swap on LE arches: */
 	common64_end(ctx, /*swap_needed:*/ BB_LITTLE_ENDIAN);
 
-	hash_size = (ctx->process_block == sha1_process_block64) ? 5 : 8;
+	hash_size = 8;
+	if (ctx->process_block == sha1_process_block64
+#if ENABLE_SHA1_HWACCEL && defined(SHA_NI)
+	 || ctx->process_block == sha1_process_block64_shaNI
+#endif
+	) {
+		hash_size = 5;
+	}
 	/* This way we do not impose alignment constraints on resbuf: */
 	if (BB_LITTLE_ENDIAN) {
 		unsigned i;
@@ -10,94 +10,180 @@
 
 #include "libbb.h"
 
-typedef struct ino_dev_hash_bucket_struct {
+/* Open addressing with linear probing, table size is a power of 2
+ * and is doubled when it gets 3/4 full. Names are not malloced
+ * one by one, they are appended to one growing buffer (arena),
+ * slots only keep offsets into it.
+ */
+typedef struct ino_dev_slot {
 	ino_t ino;
 	dev_t dev;
-	/*
-	 * Above fields can be 64-bit, while pointer may be 32-bit.
-	 * Putting "next" field here may reduce size of this struct:
-	 */
-	struct ino_dev_hash_bucket_struct *next;
+	/* offset of name in arena + 1. 0: slot is free */
+	unsigned name_ofs1;
 	/*
 	 * Reportedly, on cramfs a file and a dir can have same ino.
 	 * Need to also remember "file/dir" bit:
 	 */
 	char isdir; /* bool */
-	char name[1];
-} ino_dev_hashtable_bucket_t;
+} ino_dev_slot_t;
+
+#define INITIAL_SIZE  256u   /* Must be a power of 2 */
+
+static struct ino_dev_hashtable {
+	ino_dev_slot_t *slot;
+	unsigned size;  /* power of 2, or 0 if not allocated yet */
+	unsigned used;
+	char *arena;
+	unsigned arena_len, arena_size;
+} ino_dev_hashtable;
+#define H ino_dev_hashtable
+
+static unsigned hash_ino_dev(ino_t ino, dev_t dev)
+{
+	/* Inode numbers are often sequential: multiply to spread them */
+	unsigned long long v = (unsigned long long)ino ^ ((unsigned long long)dev << 23);
+	return (unsigned)((v * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+/* Returns the slot with this ino/dev/isdir, or the free slot
+ * where it should be inserted */
+static ino_dev_slot_t *find_slot(ino_t ino, dev_t dev, char isdir)
+{
+	unsigned mask = H.size - 1;
+	unsigned i = hash_ino_dev(ino, dev) & mask;
 
-#define HASH_SIZE      311u   /* Should be prime */
-#define hash_inode(i)  ((unsigned)(i) % HASH_SIZE)
+	for (;;) {
+		ino_dev_slot_t *s = &H.slot[i];
+		if (!s->name_ofs1)
+			return s;
+		if (s->ino == ino && s->dev == dev && s->isdir == isdir)
+			return s;
+		i = (i + 1) & mask;
+	}
+}
 
-/* array of [HASH_SIZE] elements */
-static ino_dev_hashtable_bucket_t **ino_dev_hashtable;
+static void grow_table(void)
+{
+	ino_dev_slot_t *old = H.slot;
+	unsigned old_size = H.size;
+	unsigned i;
+
+	H.size = old_size ? old_size * 2 : INITIAL_SIZE;
+	H.slot = xzalloc(H.size * sizeof(H.slot[0]));
+	for (i = 0; i < old_size; i++) {
+		if (old[i].name_ofs1)
+			*find_slot(old[i].ino, old[i].dev, old[i].isdir) = old[i];
+	}
+	free(old);
+}
 
 /*
  * Return name if statbuf->st_ino && statbuf->st_dev are recorded in
- * ino_dev_hashtable, else return NULL
+ * ino_dev_hashtable, else return NULL.
+ * Returned pointer is valid until the next add_to_ino_dev_hashtable().
  */
 char* FAST_FUNC is_in_ino_dev_hashtable(const struct stat *statbuf)
 {
-	ino_dev_hashtable_bucket_t *bucket;
+	ino_dev_slot_t *s;
 
-	if (!ino_dev_hashtable)
+	if (!H.size)
 		return NULL;
 
-	bucket = ino_dev_hashtable[hash_inode(statbuf->st_ino)];
-	while (bucket != NULL) {
-		if ((bucket->ino == statbuf->st_ino)
-		 && (bucket->dev == statbuf->st_dev)
-		 && (bucket->isdir == !!S_ISDIR(statbuf->st_mode))
-		) {
-			return bucket->name;
-		}
-		bucket = bucket->next;
-	}
-	return NULL;
+	s = find_slot(statbuf->st_ino, statbuf->st_dev, !!S_ISDIR(statbuf->st_mode));
+	if (!s->name_ofs1)
+		return NULL;
+	return H.arena + s->name_ofs1 - 1;
 }
 
 /* Add statbuf to statbuf hash table */
 void FAST_FUNC add_to_ino_dev_hashtable(const struct stat *statbuf, const char *name)
 {
-	int i;
-	ino_dev_hashtable_bucket_t *bucket;
-
-	if (!name)
-		name = "";
-	bucket = xmalloc(sizeof(ino_dev_hashtable_bucket_t) + strlen(name));
-	bucket->ino = statbuf->st_ino;
-	bucket->dev = statbuf->st_dev;
-	bucket->isdir = !!S_ISDIR(statbuf->st_mode);
-	strcpy(bucket->name, name);
-
-	if (!ino_dev_hashtable)
-		ino_dev_hashtable = xzalloc(HASH_SIZE * sizeof(*ino_dev_hashtable));
-
-	i = hash_inode(statbuf->st_ino);
-	bucket->next = ino_dev_hashtable[i];
-	ino_dev_hashtable[i] = bucket;
+	ino_dev_slot_t *s;
+	unsigned ofs;
+
+	if (H.used >= H.size / 4 * 3)
+		grow_table();
+
+	if (!H.arena) {
+		H.arena_size = 256;
+		H.arena = xzalloc(H.arena_size);
+		/* Offset 0 is a shared "" (du uses no names at all) */
+		H.arena_len = 1;
+	}
+	ofs = 0;
+	if (name && name[0]) {
+		unsigned len = strlen(name) + 1;
+		ofs = H.arena_len;
+		if (ofs + len > H.arena_size) {
+			H.arena_size = (ofs + len) * 2;
+			H.arena = xrealloc(H.arena, H.arena_size);
+		}
+		memcpy(H.arena + ofs, name, len);
+		H.arena_len = ofs + len;
+	}
+
+	s = find_slot(statbuf->st_ino, statbuf->st_dev, !!S_ISDIR(statbuf->st_mode));
+	if (!s->name_ofs1) {
+		H.used++;
+		s->ino = statbuf->st_ino;
+		s->dev = statbuf->st_dev;
+		s->isdir = !!S_ISDIR(statbuf->st_mode);
+	}
+	/* (if it was already there, the newer name wins) */
+	s->name_ofs1 = ofs + 1;
 }
 
-#if ENABLE_DU || ENABLE_FEATURE_CLEAN_UP
+#if ENABLE_DU || ENABLE_FEATURE_CLEAN_UP || ENABLE_UNIT_TEST
 /* Clear statbuf hash table */
 void FAST_FUNC reset_ino_dev_hashtable(void)
 {
-	int i;
-	ino_dev_hashtable_bucket_t *bucket, *next;
+	free(H.slot);
+	free(H.arena);
+	memset(&H, 0, sizeof(H));
+}
+#endif
 
-	if (!ino_dev_hashtable)
-		return;
+#if ENABLE_UNIT_TEST
 
-	for (i = 0; i < HASH_SIZE; i++) {
-		bucket = ino_dev_hashtable[i];
+static void test_stat(struct stat *st, char *name, unsigned i)
+{
+	st->st_ino = i * 7;
+	st->st_dev = i & 3;
+	st->st_mode = (i & 4) ? S_IFDIR : S_IFREG;
+	name[0] = '\0';
+	if (i % 3)
+		sprintf(name, "f%u", i);
+}
 
-		while (bucket != NULL) {
-			next = bucket->next;
-			free(bucket);
-			bucket = next;
-		}
+BBUNIT_DEFINE_TEST(ino_dev_hashtable)
+{
+	struct stat st;
+	char name[32];
+	unsigned i;
+
+	memset(&st, 0, sizeof(st));
+	/* enough to grow the table several times */
+	for (i = 0; i < 10000; i++) {
+		test_stat(&st, name, i);
+		add_to_ino_dev_hashtable(&st, name);
+	}
+	for (i = 0; i < 10000; i++) {
+		const char *r;
+
+		test_stat(&st, name, i);
+		r = is_in_ino_dev_hashtable(&st);
+		BBUNIT_ASSERT_NOTNULL(r);
+		BBUNIT_ASSERT_STREQ(r, name);
+		/* same ino, but a dir instead of a file or vice versa */
+		st.st_mode ^= (S_IFDIR ^ S_IFREG);
+		BBUNIT_ASSERT_NULL(is_in_ino_dev_hashtable(&st));
 	}
-	free(ino_dev_hashtable);
-	ino_dev_hashtable = NULL;
+	st.st_ino = 3;
+	BBUNIT_ASSERT_NULL(is_in_ino_dev_hashtable(&st));
+
+	BBUNIT_ENDTEST;
+
+	reset_ino_dev_hashtable();
 }
-#endif
+
+#endif /* ENABLE_UNIT_TEST */
@@ -0,0 +1,142 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * Run independent jobs in worker processes, keeping their output in order.
+ *
+ * Licensed under GPLv2 or later, see file LICENSE in this source tree.
+ */
+//kbuild:lib-$(CONFIG_FEATURE_MD5_SHA1_SUM_PARALLEL) += parallel.o
+//kbuild:lib-$(CONFIG_FEATURE_GREP_PARALLEL) += parallel.o
+//kbuild:lib-$(CONFIG_FEATURE_FIND_PARALLEL) += parallel.o
+//kbuild:lib-$(CONFIG_FEATURE_DU_PARALLEL) += parallel.o
+//kbuild:lib-$(CONFIG_FEATURE_CP_PARALLEL) += parallel.o
+
+#include "libbb.h"
+#include <sys/mman.h>
+
+/* Each worker has stdout redirected to its own (unlinked) temporary file.
+ * After every job it tells the parent which part of that file the job
+ * has written. The parent copies these parts to the real stdout
+ * in job order, so output is the same as if jobs were run one by one.
+ * Jobs are handed out via a counter in shared memory: whichever worker
+ * is free takes the next one.
+ */
+struct job_result {
+	unsigned idx;
+	unsigned worker; /* 1-based, 0: not done yet */
+	int status;
+	off_t start, end;
+};
+
+static void copy_output(int fd, off_t start, off_t end)
+{
+	char buf[4 * 1024];
+
+	while (start < end) {
+		ssize_t n = end - start;
+		if (n > (ssize_t)sizeof(buf))
+			n = sizeof(buf);
+		n = pread(fd, buf, n, start);
+		if (n <= 0)
+			bb_perror_msg_and_die("read error");
+		xwrite(STDOUT_FILENO, buf, n);
+		start += n;
+	}
+}
+
+void FAST_FUNC run_parallel_ordered(unsigned njobs, unsigned nproc,
+		int FAST_FUNC (*job)(unsigned idx, void *arg), void *arg,
+		int *status)
+{
+	struct fd_pair res_pipe;
+	struct job_result *res;
+	unsigned *next_job;
+	const char *tmpdir;
+	pid_t *pids;
+	int *outfd;
+	unsigned i, done;
+
+	if (nproc > njobs)
+		nproc = njobs;
+	if (nproc < 2) {
+		for (i = 0; i < njobs; i++) {
+			int st = job(i, arg);
+			if (status)
+				status[i] = st;
+		}
+		return;
+	}
+
+	next_job = mmap(NULL, sizeof(*next_job), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (next_job == MAP_FAILED)
+		bb_perror_msg_and_die("mmap");
+	*next_job = 0;
+
+	tmpdir = getenv("TMPDIR");
+	if (!tmpdir)
+		tmpdir = "/tmp";
+	outfd = xmalloc(nproc * sizeof(outfd[0]));
+	pids = xmalloc(nproc * sizeof(pids[0]));
+	xpiped_pair(res_pipe);
+	fflush_all();
+
+	for (i = 0; i < nproc; i++) {
+		char *name = xasprintf("%s/bbjobsXXXXXX", tmpdir);
+		outfd[i] = xmkstemp(name);
+		unlink(name);
+		free(name);
+
+		pids[i] = xfork();
+		if (pids[i] == 0) {
+			struct job_result r;
+			unsigned k;
+
+			close(res_pipe.rd);
+			for (k = 0; k < i; k++)
+				close(outfd[k]);
+			xmove_fd(outfd[i], STDOUT_FILENO);
+			r.worker = i + 1;
+			r.end = 0;
+			while ((r.idx = __sync_fetch_and_add(next_job, 1)) < njobs) {
+				r.status = job(r.idx, arg);
+				fflush_all();
+				r.start = r.end;
+				r.end = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+				/* small enough to be written atomically */
+				xwrite(res_pipe.wr, &r, sizeof(r));
+			}
+			_exit(EXIT_SUCCESS);
+		}
+	}
+	close(res_pipe.wr);
+
+	/* Output what is done, in order, as soon as possible */
+	res = xzalloc(njobs * sizeof(res[0]));
+	done = 0;
+	while (done < njobs) {
+		struct job_result r;
+
+		if (full_read(res_pipe.rd, &r, sizeof(r)) != sizeof(r))
+			break; /* all workers exited, some of them prematurely */
+		res[r.idx] = r;
+		while (done < njobs && res[done].worker) {
+			copy_output(outfd[res[done].worker - 1], res[done].start, res[done].end);
+			if (status)
+				status[done] = res[done].status;
+			done++;
+		}
+	}
+
+	close(res_pipe.rd);
+	for (i = 0; i < nproc; i++) {
+		close(outfd[i]);
+		safe_waitpid(pids[i], NULL, 0);
+	}
+	free(res);
+	free(pids);
+	free(outfd);
+	munmap(next_job, sizeof(*next_job));
+	/* A job has died (after printing error message, presumably) */
+	if (done < njobs)
+		xfunc_die();
+}
@@ -8,9 +8,18 @@
  */
 
 #include "libbb.h"
+#if defined(__linux__)
+# include <sys/syscall.h>
+#endif
 
 #undef DEBUG_RECURS_ACTION
 
+#if defined(__linux__) && defined(SYS_getdents64)
+# define USE_GETDENTS64 1
+#else
+# define USE_GETDENTS64 0
+#endif
+
 /*
  * Walk down all the directories under the specified
  * location, and do something (something specified
@@ -51,9 +60,100 @@ static int FAST_FUNC true_action(const char *fileName UNUSED_PARAM,
  * ACTION_FOLLOWLINKS mainly controls handling of links to dirs.
  * 0: lstat(statbuf). Calls fileAction on link name even if points to dir.
  * 1: stat(statbuf). Calls dirAction and optionally recurse on link to dir.
+ *
+ * ACTION_NO_STAT: fileAction looks only at file type bits of
+ * statbuf->st_mode. If readdir told us the type of a non-directory,
+ * it is not stat'ed, and the rest of statbuf is zero.
+ *
+ * Directories are opened and their entries stat'ed relative to the fd
+ * of the parent directory, so the kernel doesn't have to look up
+ * the whole path of every file again and again.
  */
 
-int FAST_FUNC recursive_action(const char *fileName,
+#if USE_GETDENTS64
+/* Bigger than readdir's buffer: fewer syscalls on huge directories */
+# define DIRBUF_SIZE (64 * 1024)
+struct linux_dirent64 {
+	uint64_t       d_ino;
+	int64_t        d_off;
+	unsigned short d_reclen;
+	unsigned char  d_type;
+	char           d_name[1];
+};
+#endif
+
+struct dir_reader {
+#if USE_GETDENTS64
+	int fd;
+	unsigned pos, len;
+	uint64_t buf[DIRBUF_SIZE / sizeof(uint64_t)];
+#else
+	DIR *dir;
+#endif
+};
+
+/* Takes ownership of fd */
+static struct dir_reader *open_dir_reader(int fd)
+{
+	struct dir_reader *dr = xmalloc(sizeof(*dr));
+#if USE_GETDENTS64
+	dr->fd = fd;
+	dr->pos = dr->len = 0;
+#else
+	dr->dir = fdopendir(fd);
+	if (!dr->dir) {
+		close(fd);
+		free(dr);
+		return NULL;
+	}
+#endif
+	return dr;
+}
+
+static void close_dir_reader(struct dir_reader *dr)
+{
+#if USE_GETDENTS64
+	close(dr->fd);
+#else
+	closedir(dr->dir);
+#endif
+	free(dr);
+}
+
+/* Returns name of next entry (and its DT_xxx type in *type),
+ * or NULL at the end of directory or on error */
+static const char *next_entry(struct dir_reader *dr, unsigned *type)
+{
+#if USE_GETDENTS64
+	struct linux_dirent64 *de;
+
+	if (dr->pos >= dr->len) {
+		long n = syscall(SYS_getdents64, dr->fd, dr->buf, DIRBUF_SIZE);
+		if (n <= 0)
+			return NULL;
+		dr->len = n;
+		dr->pos = 0;
+	}
+	de = (void*)((char*)dr->buf + dr->pos);
+	dr->pos += de->d_reclen;
+	*type = de->d_type;
+	return de->d_name;
+#else
+	struct dirent *de = readdir(dr->dir);
+	if (!de)
+		return NULL;
+# ifdef _DIRENT_HAVE_D_TYPE
+	*type = de->d_type;
+# else
+	*type = DT_UNKNOWN;
+# endif
+	return de->d_name;
+#endif
+}
+
+/* name is relative to dirfd, fileName is what callbacks see */
+static int walk(int dirfd, const char *name, const char *fileName,
+		unsigned type,
 		unsigned flags,
 		int FAST_FUNC (*fileAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
 		int FAST_FUNC (*dirAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
@@ -63,24 +163,33 @@ int FAST_FUNC recursive_action(const char *fileName,
 	struct stat statbuf;
 	unsigned follow;
 	int status;
-	DIR *dir;
-	struct dirent *next;
-
-	if (!fileAction) fileAction = true_action;
-	if (!dirAction) dirAction = true_action;
+	int fd;
+	struct dir_reader *dr;
+	const char *next;
+	unsigned next_type;
 
 	follow = ACTION_FOLLOWLINKS;
 	if (depth == 0)
 		follow = ACTION_FOLLOWLINKS | ACTION_FOLLOWLINKS_L0;
 	follow &= flags;
-	status = (follow ? stat : lstat)(fileName, &statbuf);
+
+	if ((flags & ACTION_NO_STAT)
+	 && type != DT_UNKNOWN && type != DT_DIR
+	 && !(follow && type == DT_LNK)
+	) {
+		memset(&statbuf, 0, sizeof(statbuf));
+		statbuf.st_mode = DTTOIF(type);
+		return fileAction(fileName, &statbuf, userData, depth);
+	}
+
+	status = fstatat(dirfd, name, &statbuf, follow ? 0 : AT_SYMLINK_NOFOLLOW);
 	if (status < 0) {
 #ifdef DEBUG_RECURS_ACTION
 		bb_error_msg("status=%d flags=%x", status, flags);
 #endif
 		if ((flags & ACTION_DANGLING_OK)
 		 && errno == ENOENT
-		 && lstat(fileName, &statbuf) == 0
+		 && fstatat(dirfd, name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0
 		) {
 			/* Dangling link */
 			return fileAction(fileName, &statbuf, userData, depth);
@@ -111,36 +220,33 @@ int FAST_FUNC recursive_action(const char *fileName,
 			return TRUE;
 	}
 
-	dir = opendir(fileName);
-	if (!dir) {
+	/* O_NOFOLLOW: it was not a link when we stat'ed it,
+	 * don't let anyone replace it with one meanwhile */
+	fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_NOCTTY | O_CLOEXEC
+			| (follow ? 0 : O_NOFOLLOW));
+	dr = NULL;
+	if (fd >= 0)
+		dr = open_dir_reader(fd);
+	if (!dr) {
 		/* findutils-4.1.20 reports this */
 		/* (i.e. it doesn't silently return with exit code 1) */
 		/* To trigger: "find -exec rm -rf {} \;" */
 		goto done_nak_warn;
 	}
 	status = TRUE;
-	while ((next = readdir(dir)) != NULL) {
+	while ((next = next_entry(dr, &next_type)) != NULL) {
 		char *nextFile;
 
-		nextFile = concat_subpath_file(fileName, next->d_name);
+		nextFile = concat_subpath_file(fileName, next);
 		if (nextFile == NULL)
 			continue;
 		/* process every file (NB: ACTION_RECURSE is set in flags) */
-		if (!recursive_action(nextFile, flags, fileAction, dirAction,
+		if (!walk(fd, next, nextFile, next_type, flags, fileAction, dirAction,
 						userData, depth + 1))
 			status = FALSE;
-//		s = recursive_action(nextFile, flags, fileAction, dirAction,
-//						userData, depth + 1);
 		free(nextFile);
-//#define RECURSE_RESULT_ABORT 3
-//		if (s == RECURSE_RESULT_ABORT) {
-//			closedir(dir);
-//			return s;
-//		}
-//		if (s == FALSE)
-//			status = FALSE;
 	}
-	closedir(dir);
+	close_dir_reader(dr);
 
 	if (flags & ACTION_DEPTHFIRST) {
 		if (!dirAction(fileName, &statbuf, userData, depth))
@@ -154,3 +260,18 @@ int FAST_FUNC recursive_action(const char *fileName,
 		bb_simple_perror_msg(fileName);
 	return FALSE;
 }
+
+
+int FAST_FUNC recursive_action(const char *fileName,
+		unsigned flags,
+		int FAST_FUNC (*fileAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
+		int FAST_FUNC (*dirAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
+		void* userData,
+		unsigned depth)
+{
+	if (!fileAction) fileAction = true_action;
+	if (!dirAction) dirAction = true_action;
+
+	return walk(AT_FDCWD, fileName, fileName, DT_UNKNOWN, flags,
+			fileAction, dirAction, userData, depth);
+}
@@ -293,7 +293,7 @@ static int FAST_FUNC dir_act(const char *fileName,
 	strcpy(proc_pid_fname + len - (sizeof("cmdline")-1), "fd");
 	pid_slash_progname = concat_path_file(pid, bb_basename(cmdline_buf)); /* "PID/argv0" */
 	n = recursive_action(proc_pid_fname,
-			ACTION_RECURSE | ACTION_QUIET,
+			ACTION_RECURSE | ACTION_QUIET | ACTION_NO_STAT,
 			add_to_prg_cache_if_socket,
 			NULL,
 			(void *)pid_slash_progname,
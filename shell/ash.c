@@ -223,9 +223,9 @@
 
 /* ============ Hash table sizes. Configurable. */
 
-#define VTABSIZE 39
+#define VTABSIZE 64             /* initial size, grows. Power of 2 */
 #define ATABSIZE 39
-#define CMDTABLESIZE 31         /* should be prime */
+#define CMDTABLESIZE 32         /* initial size, grows. Power of 2 */
 
 
 /* ============ Shell options */
@@ -1860,6 +1860,7 @@ static void FAST_FUNC getoptsreset(const char *value);
 struct var {
 	struct var *next;               /* next entry in hash list */
 	int flags;                      /* flags are defined above */
+	unsigned hashval;               /* varhash() of the name */
 	const char *var_text;           /* name=value */
 	void (*var_func)(const char *) FAST_FUNC; /* function to be called when  */
 					/* the variable gets set/unset */
@@ -1954,7 +1955,9 @@ struct globals_var {
 	struct shparam shellparam;      /* $@ current positional parameters */
 	struct redirtab *redirlist;
 	int preverrout_fd;   /* save fd2 before print debug if xflag is set. */
-	struct var *vartab[VTABSIZE];
+	struct var **vartab;
+	unsigned vtabsize;   /* power of 2 */
+	unsigned vtabcount;  /* number of variables in vartab */
 	struct var varinit[ARRAY_SIZE(varinit_data)];
 };
 extern struct globals_var *const ash_ptr_to_globals_var;
@@ -1963,11 +1966,15 @@ extern struct globals_var *const ash_ptr_to_globals_var;
 //#define redirlist     (G_var.redirlist    )
 #define preverrout_fd (G_var.preverrout_fd)
 #define vartab        (G_var.vartab       )
+#define vtabsize      (G_var.vtabsize     )
+#define vtabcount     (G_var.vtabcount    )
 #define varinit       (G_var.varinit      )
 #define INIT_G_var() do { \
 	unsigned i; \
 	(*(struct globals_var**)&ash_ptr_to_globals_var) = xzalloc(sizeof(G_var)); \
 	barrier(); \
+	vtabsize = VTABSIZE; \
+	vartab = xzalloc(VTABSIZE * sizeof(vartab[0])); \
 	for (i = 0; i < ARRAY_SIZE(varinit_data); i++) { \
 		varinit[i].flags    = varinit_data[i].flags; \
 		varinit[i].var_text = varinit_data[i].var_text; \
@@ -2050,18 +2057,55 @@ varcmp(const char *p, const char *q)
 	return c - d;
 }
 
+/*
+ * Hash of the name, up to the first = or '\0'.
+ * (Not just a sum of chars: v_12 and v_21 must not collide.)
+ */
+static unsigned
+varhash(const char *p)
+{
+	unsigned hashval = 5381;
+
+	while (*p && *p != '=')
+		hashval = hashval * 33 + (unsigned char) *p++;
+	return hashval;
+}
+
 /*
  * Find the appropriate entry in the hash table from the name.
  */
 static struct var **
-hashvar(const char *p)
+hashvar(unsigned hashval)
 {
-	unsigned hashval;
+	return &vartab[hashval & (vtabsize - 1)];
+}
 
-	hashval = ((unsigned char) *p) << 4;
-	while (*p && *p != '=')
-		hashval += (unsigned char) *p++;
-	return &vartab[hashval % VTABSIZE];
+/*
+ * Double the table when there are more variables than buckets,
+ * so that chains stay short even in scripts which set thousands
+ * of variables ("eval v_$i=...").
+ * Invalidates pointers into vartab.
+ */
+static void
+growvartab(void)
+{
+	struct var **old = vartab;
+	unsigned oldsize = vtabsize;
+	unsigned i;
+
+	vtabsize *= 2;
+	vartab = ckzalloc(vtabsize * sizeof(vartab[0]));
+	for (i = 0; i < oldsize; i++) {
+		struct var *vp, *next;
+
+		for (vp = old[i]; vp; vp = next) {
+			struct var **vpp = hashvar(vp->hashval);
+			next = vp->next;
+			vp->next = *vpp;
+			*vpp = vp;
+		}
+	}
+	free(old);
 }
 
 static int
@@ -2092,17 +2136,27 @@ initvar(void)
 	vp = varinit;
 	end = vp + ARRAY_SIZE(varinit);
 	do {
-		vpp = hashvar(vp->var_text);
+		vp->hashval = varhash(vp->var_text);
+		vpp = hashvar(vp->hashval);
 		vp->next = *vpp;
 		*vpp = vp;
 	} while (++vp < end);
+	vtabcount = ARRAY_SIZE(varinit);
 }
 
+/*
+ * Returns the address of the link pointing to the variable,
+ * or of the NULL link ending its hash chain if there is no such variable.
+ */
 static struct var **
-findvar(struct var **vpp, const char *name)
+findvar(const char *name, unsigned hashval)
 {
-	for (; *vpp; vpp = &(*vpp)->next) {
-		if (varcmp((*vpp)->var_text, name) == 0) {
+	struct var **vpp;
+
+	for (vpp = hashvar(hashval); *vpp; vpp = &(*vpp)->next) {
+		if ((*vpp)->hashval == hashval
+		 && varcmp((*vpp)->var_text, name) == 0
+		) {
 			break;
 		}
 	}
@@ -2117,7 +2171,7 @@ lookupvar(const char *name)
 {
 	struct var *v;
 
-	v = *findvar(hashvar(name), name);
+	v = *findvar(name, varhash(name));
 	if (v) {
 #if ENABLE_ASH_RANDOM_SUPPORT
 	/*
@@ -2178,10 +2232,12 @@ static void
 setvareq(char *s, int flags)
 {
 	struct var *vp, **vpp;
+	unsigned hashval;
 
-	vpp = hashvar(s);
+	hashval = varhash(s);
 	flags |= (VEXPORT & (((unsigned) (1 - aflag)) - 1));
-	vp = *findvar(vpp, s);
+	vpp = findvar(s, hashval);
+	vp = *vpp;
 	if (vp) {
 		if ((vp->flags & (VREADONLY|VDYNAMIC)) == VREADONLY) {
 			const char *n;
@@ -2208,9 +2264,12 @@ setvareq(char *s, int flags)
 		if (flags & VNOSET)
 			return;
 		vp = ckzalloc(sizeof(*vp));
-		vp->next = *vpp;
+		/*vp->next = NULL; - ckzalloc did it */
 		/*vp->func = NULL; - ckzalloc did it */
+		vp->hashval = hashval;
 		*vpp = vp;
+		if (++vtabcount > vtabsize)
+			growvartab();
 	}
 	if (!(flags & (VTEXTFIXED|VSTACK|VNOSAVE)))
 		s = ckstrdup(s);
@@ -2271,7 +2330,7 @@ unsetvar(const char *s)
 	struct var *vp;
 	int retval;
 
-	vpp = findvar(hashvar(s), s);
+	vpp = findvar(s, varhash(s));
 	vp = *vpp;
 	retval = 2;
 	if (vp) {
@@ -2291,6 +2350,7 @@ unsetvar(const char *s)
 				free((char*)vp->var_text);
 			*vpp = vp->next;
 			free(vp);
+			vtabcount--;
 			INT_ON;
 		} else {
 			setvar0(s, NULL);
@@ -2343,7 +2403,7 @@ listvars(int on, int off, char ***end)
 				*ep++ = (char*)vp->var_text;
 			}
 		}
-	} while (++vpp < vartab + VTABSIZE);
+	} while (++vpp < vartab + vtabsize);
 	if (ep == stackstrend())
 		ep = growstackstr();
 	if (end)
@@ -4908,6 +4968,9 @@ forkparent(struct job *jp, union node *n, int mode, pid_t pid)
 	}
 }
 
+/* Bump it to forget commands which were not found in PATH, see cmdmiss[] */
+static unsigned cmdmiss_gen;
+
 /* jp and n are NULL when called by openhere() for heredoc support */
 static int
 forkshell(struct job *jp, union node *n, int mode)
@@ -4926,6 +4989,8 @@ forkshell(struct job *jp, union node *n, int mode)
 		CLEAR_RANDOM_T(&random_gen); /* or else $RANDOM repeats in child */
 		forkchild(jp, n, mode);
 	} else {
+		/* the child may create the commands we did not find */
+		cmdmiss_gen++;
 		forkparent(jp, n, mode, pid);
 	}
 	return pid;
@@ -5170,6 +5235,8 @@ openredirect(union node *redir)
 	 * allocated space. Do it only when we know it is safe.
 	 */
 	fname = redir->nfile.expfname;
+	if (redir->nfile.type != NFROM)
+		cmdmiss_gen++; /* may create a file */
 
 	switch (redir->nfile.type) {
 	default:
@@ -7039,6 +7106,26 @@ addfname(const char *name)
 	exparg.lastp = &sp->next;
 }
 
+/*
+ * Does the word need globbing? '[' without a closing ']' is not
+ * a pattern: "[ $x = y ]" would needlessly read the directory otherwise.
+ */
+static int
+has_glob_meta(const char *p)
+{
+	const char *br = NULL;
+
+	for (; *p; p++) {
+		if (*p == '*' || *p == '?')
+			return 1;
+		if (*p == '[')
+			br = p;
+		else if (*p == ']' && br)
+			return 1;
+	}
+	return 0;
+}
+
 /* If we want to use glob() from libc... */
 #if !ENABLE_ASH_INTERNAL_GLOB
 
@@ -7066,19 +7153,9 @@ expandmeta(struct strlist *str /*, int flag*/)
 			goto nometa;
 
 		/* Avoid glob() (and thus, stat() et al) for words like "echo" */
-		p = str->text;
-		while (*p) {
-			if (*p == '*')
-				goto need_glob;
-			if (*p == '?')
-				goto need_glob;
-			if (*p == '[')
-				goto need_glob;
-			p++;
-		}
-		goto nometa;
+		if (!has_glob_meta(str->text))
+			goto nometa;
 
- need_glob:
 		INT_OFF;
 		p = preglob(str->text, RMESCAPE_ALLOC | RMESCAPE_HEAP);
 // GLOB_NOMAGIC (GNU): if no *?[ chars in pattern, return it even if no match
@@ -7315,9 +7392,6 @@ expsort(struct strlist *str)
 static void
 expandmeta(struct strlist *str /*, int flag*/)
 {
-	static const char metachars[] ALIGN1 = {
-		'*', '?', '[', 0
-	};
 	/* TODO - EXP_REDIR */
 
 	while (str) {
@@ -7328,7 +7402,7 @@ expandmeta(struct strlist *str /*, int flag*/)
 
 		if (fflag)
 			goto nometa;
-		if (!strpbrk(str->text, metachars))
+		if (!has_glob_meta(str->text))
 			goto nometa;
 		savelastp = exparg.lastp;
 
@@ -7376,6 +7450,29 @@ expandarg(union node *arg, struct arglist *arglist, int flag)
 	struct strlist *sp;
 	char *p;
 
+	/* Most words in scripts are plain literals ("test", "-lt", "]"):
+	 * no quotes, no $, no tilde, nothing to glob. Expanding them
+	 * gives the same text, so don't run them through argstr,
+	 * field splitting and globbing on every loop iteration.
+	 */
+	if (arglist && !arg->narg.backquote) {
+		unsigned char *t = (unsigned char *)arg->narg.text;
+		while (*t) {
+			if (*t >= CTL_FIRST && *t <= CTL_LAST)
+				goto slow;
+			if (*t == '~' && (flag & (EXP_TILDE | EXP_VARTILDE)))
+				goto slow;
+			t++;
+		}
+		if ((flag & EXP_FULL) && !fflag && has_glob_meta(arg->narg.text))
+			goto slow;
+		sp = stzalloc(sizeof(*sp));
+		sp->text = sstrdup(arg->narg.text);
+		*arglist->lastp = sp;
+		arglist->lastp = &sp->next;
+		return;
+	}
+ slow:
 	argbackq = arg->narg.backquote;
 	STARTSTACKSTR(expdest);
 	TRACE(("expandarg: argstr('%s',flags:%x)\n", arg->narg.text, flag));
@@ -7514,16 +7611,37 @@ static void find_command(char *, struct cmdentry *, int, const char *);
 struct tblentry {
 	struct tblentry *next;  /* next entry in hash chain */
 	union param param;      /* definition of builtin function */
+	unsigned hashval;       /* cmdhash() of cmdname */
 	smallint cmdtype;       /* CMDxxx */
 	char rehash;            /* if set, cd done since entry created */
 	char cmdname[1];        /* name of command */
 };
 
 static struct tblentry **cmdtable;
+static unsigned cmdtabsize;     /* power of 2 */
+static unsigned cmdtabcount;    /* number of entries in cmdtable */
 #define INIT_G_cmdtable() do { \
+	cmdtabsize = CMDTABLESIZE; \
 	cmdtable = xzalloc(CMDTABLESIZE * sizeof(cmdtable[0])); \
 } while (0)
 
+/*
+ * Names recently not found in PATH. Without this, a script which
+ * keeps probing for a missing command stats every PATH element
+ * each time. A miss is remembered only while nothing could have
+ * created the command: PATH is not changed, no cd/hash -r,
+ * no child processes or applets run, no files created by
+ * redirections - and for at most a second, to notice commands
+ * installed by someone else.
+ */
+#define CMDMISS_SIZE 16         /* Power of 2 */
+static struct cmdmiss {
+	char *name;
+	unsigned hashval;
+	unsigned gen;
+	unsigned sec;
+} cmdmiss[CMDMISS_SIZE];
+
 static int builtinloc = -1;     /* index in path of %builtin, or -1 */
 
 
@@ -7671,7 +7789,8 @@ clearcmdentry(int firstchange)
 	struct tblentry *cmdp;
 
 	INT_OFF;
-	for (tblp = cmdtable; tblp < &cmdtable[CMDTABLESIZE]; tblp++) {
+	cmdmiss_gen++;
+	for (tblp = cmdtable; tblp < &cmdtable[cmdtabsize]; tblp++) {
 		pp = tblp;
 		while ((cmdp = *pp) != NULL) {
 			if ((cmdp->cmdtype == CMDNORMAL &&
@@ -7681,6 +7800,7 @@ clearcmdentry(int firstchange)
 			) {
 				*pp = cmdp->next;
 				free(cmdp);
+				cmdtabcount--;
 			} else {
 				pp = &cmdp->next;
 			}
@@ -7700,22 +7820,54 @@ clearcmdentry(int firstchange)
  */
 static struct tblentry **lastcmdentry;
 
+static unsigned
+cmdhash(const char *p)
+{
+	unsigned hashval = 5381;
+
+	while (*p)
+		hashval = hashval * 33 + (unsigned char)*p++;
+	return hashval;
+}
+
+/*
+ * Double the table when there are more commands (hashed programs
+ * and functions) than buckets. Invalidates lastcmdentry.
+ */
+static void
+growcmdtable(void)
+{
+	struct tblentry **old = cmdtable;
+	unsigned oldsize = cmdtabsize;
+	unsigned i;
+
+	cmdtabsize *= 2;
+	cmdtable = ckzalloc(cmdtabsize * sizeof(cmdtable[0]));
+	for (i = 0; i < oldsize; i++) {
+		struct tblentry *cmdp, *next;
+
+		for (cmdp = old[i]; cmdp; cmdp = next) {
+			struct tblentry **pp = &cmdtable[cmdp->hashval & (cmdtabsize - 1)];
+			next = cmdp->next;
+			cmdp->next = *pp;
+			*pp = cmdp;
+		}
+	}
+	free(old);
+}
+
 static struct tblentry *
 cmdlookup(const char *name, int add)
 {
-	unsigned int hashval;
-	const char *p;
+	unsigned hashval;
 	struct tblentry *cmdp;
 	struct tblentry **pp;
 
-	p = name;
-	hashval = (unsigned char)*p << 4;
-	while (*p)
-		hashval += (unsigned char)*p++;
-	hashval &= 0x7FFF;
-	pp = &cmdtable[hashval % CMDTABLESIZE];
+	hashval = cmdhash(name);
+ again:
+	pp = &cmdtable[hashval & (cmdtabsize - 1)];
 	for (cmdp = *pp; cmdp; cmdp = cmdp->next) {
-		if (strcmp(cmdp->cmdname, name) == 0)
+		if (cmdp->hashval == hashval && strcmp(cmdp->cmdname, name) == 0)
 			break;
 		pp = &cmdp->next;
 	}
@@ -7725,8 +7877,14 @@ cmdlookup(const char *name, int add)
 				/* + 1 - already done because
 				 * tblentry::cmdname is char[1] */);
 		/*cmdp->next = NULL; - ckzalloc did it */
+		cmdp->hashval = hashval;
 		cmdp->cmdtype = CMDUNKNOWN;
 		strcpy(cmdp->cmdname, name);
+		if (++cmdtabcount > cmdtabsize) {
+			growcmdtable();
+			/* find it again to set lastcmdentry */
+			goto again;
+		}
 	}
 	lastcmdentry = pp;
 	return cmdp;
@@ -7746,6 +7904,33 @@ delete_cmd_entry(void)
 	if (cmdp->cmdtype == CMDFUNCTION)
 		freefunc(cmdp->param.func);
 	free(cmdp);
+	cmdtabcount--;
+	INT_ON;
+}
+
+static int
+cmd_recently_missed(const char *name, unsigned hashval)
+{
+	struct cmdmiss *m = &cmdmiss[hashval & (CMDMISS_SIZE - 1)];
+
+	return m->name
+		&& m->gen == cmdmiss_gen
+		&& (unsigned)monotonic_sec() - m->sec <= 1
+		&& m->hashval == hashval
+		&& strcmp(m->name, name) == 0;
+}
+
+static void
+remember_cmd_miss(const char *name, unsigned hashval)
+{
+	struct cmdmiss *m = &cmdmiss[hashval & (CMDMISS_SIZE - 1)];
+
+	INT_OFF;
+	free(m->name);
+	m->name = ckstrdup(name);
+	m->hashval = hashval;
+	m->gen = cmdmiss_gen;
+	m->sec = monotonic_sec();
 	INT_ON;
 }
 
@@ -7782,7 +7967,7 @@ hashcmd(int argc UNUSED_PARAM, char **argv UNUSED_PARAM)
 	}
 
 	if (*argptr == NULL) {
-		for (pp = cmdtable; pp < &cmdtable[CMDTABLESIZE]; pp++) {
+		for (pp = cmdtable; pp < &cmdtable[cmdtabsize]; pp++) {
 			for (cmdp = *pp; cmdp; cmdp = cmdp->next) {
 				if (cmdp->cmdtype == CMDNORMAL)
 					printentry(cmdp);
@@ -7818,7 +8003,8 @@ hashcd(void)
 	struct tblentry **pp;
 	struct tblentry *cmdp;
 
-	for (pp = cmdtable; pp < &cmdtable[CMDTABLESIZE]; pp++) {
+	cmdmiss_gen++; /* PATH may have relative dirs */
+	for (pp = cmdtable; pp < &cmdtable[cmdtabsize]; pp++) {
 		for (cmdp = *pp; cmdp; cmdp = cmdp->next) {
 			if (cmdp->cmdtype == CMDNORMAL
 			 || (cmdp->cmdtype == CMDBUILTIN
@@ -9100,7 +9286,6 @@ static void
 mklocal(char *name)
 {
 	struct localvar *lvp;
-	struct var **vpp;
 	struct var *vp;
 	char *eq = strchr(name, '=');
 
@@ -9129,15 +9314,17 @@ mklocal(char *name)
 		lvp->text = memcpy(p, optlist, sizeof(optlist));
 		vp = NULL;
 	} else {
-		vpp = hashvar(name);
-		vp = *findvar(vpp, name);
+		unsigned hashval = varhash(name);
+
+		vp = *findvar(name, hashval);
 		if (vp == NULL) {
 			/* variable did not exist yet */
 			if (eq)
 				setvareq(name, VSTRFIXED);
 			else
 				setvar(name, NULL, VSTRFIXED);
-			vp = *vpp;      /* the new variable */
+			/* the new variable (vartab may have been reallocated) */
+			vp = *findvar(name, hashval);
 			lvp->flags = VUNSET;
 		} else {
 			lvp->text = vp->var_text;
@@ -9583,6 +9770,7 @@ evalcommand(union node *cmd, int flags)
 		int applet_no = (- cmdentry.u.index - 2);
 		if (applet_no >= 0 && APPLET_IS_NOFORK(applet_no)) {
 			listsetvar(varlist.list, VEXPORT|VSTACK);
+			cmdmiss_gen++;
 			/* run <applet>_main() */
 			status = run_nofork_applet(applet_no, argv);
 			break;
@@ -12679,6 +12867,8 @@ find_command(char *name, struct cmdentry *entry, int act, const char *path)
 	}
 
 	e = ENOENT;
+	if (!cmdp && updatetbl && cmd_recently_missed(name, cmdhash(name)))
+		goto fail;
 	idx = -1;
  loop:
 	while ((fullname = path_advance(&path, name)) != NULL) {
@@ -12746,6 +12936,9 @@ find_command(char *name, struct cmdentry *entry, int act, const char *path)
 	/* We failed.  If there was an entry for this command, delete it */
 	if (cmdp && updatetbl)
 		delete_cmd_entry();
+	if (!cmdp && updatetbl && e == ENOENT && !strchr(pathval(), '%'))
+		remember_cmd_miss(name, cmdhash(name));
+ fail:
 	if (act & DO_ERR)
 		ash_msg("%s: %s", name, errmsg(e, "not found"));
 	entry->cmdtype = CMDUNKNOWN;
@@ -12928,7 +13121,7 @@ exportcmd(int argc UNUSED_PARAM, char **argv)
 				if (p != NULL) {
 					p++;
 				} else {
-					vp = *findvar(hashvar(name), name);
+					vp = *findvar(name, varhash(name));
 					if (vp) {
 						vp->flags = ((vp->flags | flag) & flag_off);
 						continue;
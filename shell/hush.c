@@ -93,6 +93,7 @@
 # include <fnmatch.h>
 #endif
 #include <sys/utsname.h> /* for setting $HOSTNAME */
+#include <sys/syscall.h> /* for __NR_memfd_create */
 
 #include "busybox.h"  /* for APPLET_IS_NOFORK/NOEXEC */
 #include "unicode.h"
@@ -6240,6 +6241,8 @@ static FILE *generate_stream_from_string(const char *s, pid_t *pid_p)
 	return remember_FILE(xfdopen_for_read(channel[0]));
 }
 
+static FILE *cmdsubst_without_fork(const char *s, int *status_p);
+
 /* Return code is exit status of the process that is run. */
 static int process_command_subs(o_string *dest, const char *s)
 {
@@ -6248,7 +6251,10 @@ static int process_command_subs(o_string *dest, const char *s)
 	pid_t pid;
 	int status, ch, eol_cnt;
 
-	fp = generate_stream_from_string(s, &pid);
+	pid = 0;
+	fp = cmdsubst_without_fork(s, &status);
+	if (!fp)
+		fp = generate_stream_from_string(s, &pid);
 
 	/* Now send results of command back into original context */
 	setup_file_in_str(&pipe_str, fp);
@@ -6267,6 +6273,8 @@ static int process_command_subs(o_string *dest, const char *s)
 
 	debug_printf("done reading from `cmd` pipe, closing it\n");
 	fclose_and_forget(fp);
+	if (!pid)
+		return status;
 	/* We need to extract exitcode. Test case
 	 * "true; echo `sleep 1; false` $?"
 	 * should print 1 */
@@ -7355,6 +7363,167 @@ static int redirect_and_varexp_helper(char ***new_env_p,
 	}
 	return rcode;
 }
+
+/* Running a command in a child is needed only if it may change
+ * the shell's state. Commands in $(cmd) and in pipes are run in children,
+ * but a builtin like echo or a NOFORK applet like basename, cat
+ * can be run in the shell itself, saving fork (+exec): "$(basename $f)",
+ * "... | cat". Only if expanding their words has no side effects
+ * (${v=x}, $((i++)) etc. would modify the shell's variables).
+ */
+static int is_pure_word(const char *w)
+{
+	while ((w = strchr(w, SPECIAL_VAR_SYMBOL)) != NULL) {
+		const char *end = strchr(++w, SPECIAL_VAR_SYMBOL);
+		const char *p;
+
+		if (!end)
+			return 0;
+		/* `cmd` runs in a subshell (or is pure itself) */
+		if ((*w & 0x7f) != '`') {
+			/* Skip var name's 1st char, it may be $? or $- */
+			for (p = w + 1; p < end; p++) {
+				if (strchr("=?$`", *p))
+					return 0;
+				if ((*p == '+' || *p == '-') && p[1] == *p)
+					return 0;
+			}
+		}
+		w = end + 1;
+	}
+	return 1;
+}
+
+static int can_run_without_fork(struct command *command)
+{
+	const struct built_in_command *x;
+	struct redir_struct *redir;
+	char **argv;
+	const char *name;
+
+	if (!command->argv || command->group || command->cmd_type != CMD_NORMAL)
+		return 0;
+	name = command->argv[command->assignment_cnt];
+	if (!name || strchr(name, SPECIAL_VAR_SYMBOL) || strchr(name, '\\'))
+		return 0;
+	x = find_builtin(name);
+	if (x) {
+		/* The builtins which don't touch the shell's state */
+		if (x < bltins2 || x >= &bltins2[ARRAY_SIZE(bltins2)])
+			return 0;
+	} else {
+		int n;
+#if ENABLE_HUSH_FUNCTIONS
+		if (find_function(name))
+			return 0;
+#endif
+		if (!ENABLE_FEATURE_SH_NOFORK)
+			return 0;
+		n = find_applet_by_name(name);
+		if (n < 0 || !APPLET_IS_NOFORK(n))
+			return 0;
+	}
+	for (argv = command->argv; *argv; argv++)
+		if (!is_pure_word(*argv))
+			return 0;
+	for (redir = command->redirects; redir; redir = redir->next) {
+		if (redir->rd_type == REDIRECT_HEREDOC
+		 || redir->rd_type == REDIRECT_HEREDOC2
+		 || (redir->rd_filename && !is_pure_word(redir->rd_filename))
+		) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Run command for which can_run_without_fork() is true, with its
+ * fd (stdin of last cmd in a pipe, or stdout of $(cmd)) replaced by newfd.
+ */
+static int run_without_fork(struct command *command, int fd, int newfd)
+{
+	int squirrel[] = { -1, -1, -1 };
+	char **new_env = NULL;
+	struct variable *old_vars = NULL;
+	char **argv_expanded;
+	int rcode;
+
+	fflush_all();
+	save_fds_on_redirect(fd, squirrel);
+	xdup2(newfd, fd);
+	argv_expanded = expand_strvec_to_strvec(command->argv + command->assignment_cnt);
+	rcode = redirect_and_varexp_helper(&new_env, &old_vars, command, squirrel, argv_expanded);
+	if (rcode == 0) {
+		const struct built_in_command *x = find_builtin(argv_expanded[0]);
+		debug_printf_exec(": run '%s' '%s' without fork\n",
+				argv_expanded[0], argv_expanded[1]);
+		if (x)
+			rcode = x->b_function(argv_expanded) & 0xff;
+		else if (ENABLE_FEATURE_SH_NOFORK)
+			rcode = run_nofork_applet(find_applet_by_name(argv_expanded[0]), argv_expanded);
+		fflush_all();
+	}
+	unset_vars(new_env);
+	add_vars(old_vars);
+	if (squirrel[fd] < 0) /* fd was not open */
+		close(fd);
+	restore_redirects(squirrel);
+	free(argv_expanded);
+	return rcode;
+}
+
+#if ENABLE_HUSH_TICK
+/* If cmd in $(cmd) can run without fork, do it with stdout
+ * going to a memory file. Returns it for reading the output from,
+ * or NULL if a child has to be forked for cmd.
+ */
+static FILE *cmdsubst_without_fork(const char *s, int *status_p)
+{
+	FILE *fp = NULL;
+# ifdef __NR_memfd_create
+	struct in_str input;
+	struct pipe *pi;
+	int fd, rcode;
+
+	/* Only a simple command. (Lists, pipes, nested $(cmd)
+	 * and redirects would be pointless to analyze: rare here) */
+	/* (backslash at EOF would make parser exit) */
+	if (strpbrk(s, ";&|<>()`\\\n"))
+		return NULL;
+	rcode = G.last_exitcode;
+	setup_string_in_str(&input, s);
+	pi = parse_stream(NULL, &input, '\0');
+	if (!pi)
+		return NULL;
+	if (pi == ERR_PTR) {
+		/* Error message is already shown, exactly as a child
+		 * would show it. Output is empty, exit code is 1 */
+		G.last_exitcode = rcode;
+		rcode = 1;
+		pi = NULL;
+		goto capture;
+	}
+	/* (parser leaves an empty pipe at the end) */
+	if (pi->num_cmds == 1
+	 && (!pi->next || (pi->next->num_cmds == 0 && !pi->next->next))
+	 IF_HAS_KEYWORDS(&& !pi->pi_inverted)
+	 && can_run_without_fork(&pi->cmds[0])
+	) {
+ capture:
+		fd = syscall(__NR_memfd_create, "hush", 1 /* MFD_CLOEXEC */);
+		if (fd >= 0) {
+			if (pi)
+				rcode = run_without_fork(&pi->cmds[0], STDOUT_FILENO, fd);
+			*status_p = rcode;
+			xlseek(fd, 0, SEEK_SET);
+			fp = remember_FILE(xfdopen_for_read(fd));
+		}
+	}
+	free_pipe_list(pi);
+# endif
+	return fp;
+}
+#endif
 static NOINLINE int run_pipe(struct pipe *pi)
 {
 	static const char *const null_ptr = NULL;
@@ -7615,6 +7784,18 @@ static NOINLINE int run_pipe(struct pipe *pi)
 			debug_printf_exec(": pipe member with no argv\n");
 		}
 
+		/* Last cmd of a fg pipe: maybe it needs no child */
+		if (cmd_no == pi->num_cmds && cmd_no > 1
+		 && pi->followup != PIPE_BG
+		 && !G_interactive_fd /* not messing with job control */
+		 && can_run_without_fork(command)
+		) {
+			command->cmd_exitcode = run_without_fork(command, STDIN_FILENO, next_infd);
+			command->pid = 0;
+			close(next_infd);
+			break;
+		}
+
 		/* pipes are inserted between pairs of commands */
 		pipefds.rd = 0;
 		pipefds.wr = 1;
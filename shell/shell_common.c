@@ -68,6 +68,9 @@ shell_builtin_read(void FAST_FUNC (*setvar)(const char *name, const char *val),
 	int bufpos; /* need to be able to hold -1 */
 	int startword;
 	smallint backslash;
+	char *rbuf; /* read-ahead buffer, used for regular files */
+	int rpos, rlen;
+	struct stat st;
 
 	errno = err = 0;
 
@@ -165,6 +168,17 @@ shell_builtin_read(void FAST_FUNC (*setvar)(const char *name, const char *val),
 		end_ms = ((unsigned)monotonic_ms() + end_ms) | 1;
 	buffer = NULL;
 	bufpos = 0;
+	/* Reading a char at a time is slow. From a regular file we can
+	 * read ahead, and seek back over the unused part at exit (bash does
+	 * the same), so that the next reader of fd starts at the right place.
+	 * Regular files are always readable, no need to poll them.
+	 * Not /proc files (they have zero size): seeking back makes
+	 * the kernel regenerate them, and "while read" becomes quadratic.
+	 */
+	rbuf = NULL;
+	rpos = rlen = 0;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+		rbuf = xmalloc(1024);
 	do {
 		char c;
 		struct pollfd pfd[1];
@@ -173,6 +187,22 @@ shell_builtin_read(void FAST_FUNC (*setvar)(const char *name, const char *val),
 		if ((bufpos & 0xff) == 0)
 			buffer = xrealloc(buffer, bufpos + 0x101);
 
+		if (rbuf) {
+			if (rpos == rlen) {
+				errno = 0;
+				rpos = 0;
+				rlen = read(fd, rbuf, 1024);
+				if (rlen <= 0) {
+					rlen = 0;
+					err = errno;
+					retval = (const char *)(uintptr_t)1;
+					break;
+				}
+			}
+			buffer[bufpos] = rbuf[rpos++];
+			goto got_char;
+		}
+
 		timeout = -1;
 		if (end_ms) {
 			timeout = end_ms - (unsigned)monotonic_ms();
@@ -201,6 +231,7 @@ shell_builtin_read(void FAST_FUNC (*setvar)(const char *name, const char *val),
 			break;
 		}
 
+ got_char:
 		c = buffer[bufpos];
 		if (c == '\0')
 			continue;
@@ -265,6 +296,11 @@ shell_builtin_read(void FAST_FUNC (*setvar)(const char *name, const char *val),
 
  ret:
 	free(buffer);
+	if (rbuf) {
+		if (rpos < rlen)
+			lseek(fd, rpos - rlen, SEEK_CUR);
+		free(rbuf);
+	}
 	if (read_flags & BUILTIN_READ_SILENT)
 		tcsetattr(fd, TCSANOW, &old_tty);
 
@@ -0,0 +1,91 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * Micro-benchmark of libbb/inode_hash.c (hard link tracking of du, cp -a).
+ * Build it against a configured tree and run:
+ *
+ * gcc -O2 -include $builddir/include/autoconf.h \
+ *	-I$builddir/include -I$srcdir/include \
+ *	$srcdir/testsuite/inode_hash_bench.c -o inode_hash_bench
+ * ./inode_hash_bench [NUMBER_OF_INODES]
+ *
+ * Prints insert and lookup (hit and miss) rates.
+ *
+ * Licensed under GPLv2 or later, see file LICENSE in this source tree.
+ */
+/* Don't need bbunit */
+#undef ENABLE_UNIT_TEST
+#define ENABLE_UNIT_TEST 0
+#include "../libbb/inode_hash.c"
+#include <time.h>
+
+/* The only libbb functions inode_hash.c needs */
+void* FAST_FUNC xrealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	if (!ptr && size) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+void* FAST_FUNC xzalloc(size_t size)
+{
+	return memset(xrealloc(NULL, size), 0, size);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *what, unsigned n, double t)
+{
+	printf("%-8s %9u in %6.3f s: %6.2f M/s\n", what, n, t, n / t / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	struct stat st;
+	char name[64];
+	unsigned n, i, found;
+	double t;
+
+	n = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+	memset(&st, 0, sizeof(st));
+	st.st_mode = S_IFREG;
+	st.st_dev = 0x801;
+
+	/* Inodes of a real tree are mostly sequential with gaps */
+	t = now();
+	for (i = 0; i < n; i++) {
+		st.st_ino = 1000 + i * 3;
+		sprintf(name, "backup/snapshot/dir%u/file%u", i / 1000, i);
+		add_to_ino_dev_hashtable(&st, name);
+	}
+	report("insert", n, now() - t);
+
+	found = 0;
+	t = now();
+	for (i = 0; i < n; i++) {
+		st.st_ino = 1000 + i * 3;
+		found += (is_in_ino_dev_hashtable(&st) != NULL);
+	}
+	report("hit", n, now() - t);
+
+	t = now();
+	for (i = 0; i < n; i++) {
+		st.st_ino = 1001 + i * 3;
+		found += (is_in_ino_dev_hashtable(&st) != NULL);
+	}
+	report("miss", n, now() - t);
+
+	reset_ino_dev_hashtable();
+	if (found != n) {
+		printf("error: found %u of %u\n", found, n);
+		return 1;
+	}
+	return 0;
+}